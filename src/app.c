@@ -19,6 +19,10 @@
 #include <sel4utils/sel4_zf_logif.h>
 
 #include "../src/ring.h"
+#include "../src/transport.h"
+#include "../src/poll.h"
+#include "../src/receiver.h"
+#include "../src/ipc.h"
 
 static struct fring *req_fring = NULL;
 static struct fring *rsp_fring = NULL;
@@ -27,92 +31,92 @@ static struct aring *rsp_aring = NULL;
 static void *req_data_buf = NULL;
 static void *rsp_data_buf = NULL;
 
-static seL4_CPtr receive_ep = 0;
-static seL4_CPtr send_ep = 0;
+static struct transport req_tp; /* receiving end of the request channel */
+static struct transport rsp_tp; /* sending end of the response channel */
+static struct poller req_poll;
 
-static void init_rings(void *shared_mem) {
-    req_fring = REQ_FRING(shared_mem);
-    rsp_fring = RSP_FRING(shared_mem);
-    req_aring = REQ_ARING(shared_mem);
-    rsp_aring = RSP_ARING(shared_mem);
-    req_data_buf = REQ_DATA_BUF(shared_mem);
-    rsp_data_buf = RSP_DATA_BUF(shared_mem);
-}
-
-static void send_message(unsigned long m0, unsigned long m1, unsigned long m2, unsigned long m3) {
-    unsigned long idx;
-    unsigned long *slot;
-
-    while ((idx = lfring_dequeue((struct lfring *) rsp_fring->ring, RING_ORDER, false)) == LFRING_EMPTY) {
-        /* spin for available idx from free ring */
-    }
-
-    slot = (unsigned long *)((char *)rsp_data_buf + idx * DATA_SLOT_SIZE);
-    slot[0] = m0;
-    slot[1] = m1;
-    slot[2] = m2;
-    slot[3] = m3;
+/* app sleeps on one notification, for requests and for response slots alike */
+static seL4_CPtr app_ntfn = 0;
+static seL4_CPtr rsp_doorbell = 0;
+static seL4_CPtr req_credit = 0;
+static seL4_CPtr rsp_credit = 0;
+static seL4_CPtr ipc_ep = 0; /* main's native IPC baseline */
 
-    lfring_enqueue((struct lfring *)rsp_aring->ring, RING_ORDER, idx, false);
+#ifdef RING_PMU
+/* counters of app's core, published to main whenever app runs out of requests */
+static struct pmu pmu;
+static struct pmu_block *pmu_block = NULL;
+#endif
 
-    if (atomic_load(&rsp_aring->readers) <= 0) {
-        seL4_Signal(send_ep);
-    }
+static void init_rings(void *shared_mem) {
+    const struct layout *layout = LAYOUT(shared_mem);
+
+    /* main wrote the header before spawning us */
+    layout_check(layout);
+    req_fring = layout_region(shared_mem, layout, &layout->req.fring);
+    rsp_fring = layout_region(shared_mem, layout, &layout->rsp.fring);
+    req_aring = layout_region(shared_mem, layout, &layout->req.aring);
+    rsp_aring = layout_region(shared_mem, layout, &layout->rsp.aring);
+    req_data_buf = layout_region(shared_mem, layout, &layout->req.data);
+    rsp_data_buf = layout_region(shared_mem, layout, &layout->rsp.data);
+
+    transport_init(&req_tp, req_fring, req_aring, req_data_buf, seL4_CapNull, req_credit);
+    transport_init(&rsp_tp, rsp_fring, rsp_aring, rsp_data_buf, rsp_doorbell, rsp_credit);
+    poll_init(&req_poll, &req_aring->poll_mode);
+
+#ifdef RING_STATS
+    /* main zeroed the stats page before spawning us */
+    struct stats_page *stats = layout_region(shared_mem, layout, &layout->stats);
+
+    transport_set_stats(&req_tp, &stats->req_recv);
+    transport_set_stats(&rsp_tp, &stats->rsp_send);
+#endif
+#ifdef RING_TRACE
+    struct trace_area *trace = layout_region(shared_mem, layout, &layout->trace);
+
+    transport_set_trace(&req_tp, &trace->req_recv);
+    transport_set_trace(&rsp_tp, &trace->rsp_send);
+#endif
+#ifdef RING_PMU
+    /* main zeroed the block, the first totals are its baseline */
+    pmu_block = layout_region(shared_mem, layout, &layout->pmu);
+    pmu_open(&pmu, 0);
+    pmu_publish(pmu_block, &pmu, 0);
+#endif
 }
 
 static void receiver(void) {
-    unsigned long idx;
-    unsigned long fails = 0;
-    unsigned long *slot;
-
-    assert(receive_ep != 0);
-    assert(req_fring != NULL);
-
-start_over:
-    atomic_store(&req_aring->readers, 1);
-    fails = 0;
-again:
-    while ((idx = lfring_dequeue((struct lfring *)req_aring->ring,
-        RING_ORDER, false)) != LFRING_EMPTY) {
-retry:
-        fails = 0;
-
-        slot = (unsigned long *)((char *)req_data_buf + idx * DATA_SLOT_SIZE);
-        send_message(slot[0], slot[1], slot[2], slot[3]);
-
-        lfring_enqueue((struct lfring *) req_fring->ring,
-            RING_ORDER, idx, false);
-    }
-    if (++fails < 1024) {
-        goto again;
-    }
-    atomic_store(&req_aring->readers, -1);
-
-    idx = lfring_dequeue((struct lfring *)req_aring->ring,
-        RING_ORDER, false);
-    if (idx != LFRING_EMPTY) {
-        atomic_store(&req_aring->readers, 1);
-        goto retry;
-    }
-
-    seL4_Wait(receive_ep, NULL);
-
-    goto start_over;
+    struct receiver r;
+
+    assert(app_ntfn != 0);
+    assert(req_aring != NULL);
+
+    receiver_init(&r, &req_tp, &req_poll, app_ntfn, NULL);
+#ifdef RING_PMU
+    receiver_set_pmu(&r, &pmu, pmu_block);
+#endif
+    receiver_echo(&r, &rsp_tp);
 }
 
 int main(int argc, char **argv) {
     printf("App: hey hey hey\n");
 
-    /* check arguments and get badged endpoint */
-    ZF_LOGF_IF(argc < 3, "Missing arguments.\n");
-    receive_ep = (seL4_CPtr) atol(argv[0]);
-    send_ep = (seL4_CPtr) atol(argv[1]);
+    /* check arguments and get the notification and endpoint caps */
+    ZF_LOGF_IF(argc < 6, "Missing arguments.\n");
+    app_ntfn = (seL4_CPtr) atol(argv[0]);
+    rsp_doorbell = (seL4_CPtr) atol(argv[1]);
+    req_credit = (seL4_CPtr) atol(argv[3]);
+    rsp_credit = (seL4_CPtr) atol(argv[4]);
+    ipc_ep = (seL4_CPtr) atol(argv[5]);
 
     /* get shared memory address */
     void *shared_mem = (void *) atol(argv[2]);
 
     init_rings(shared_mem);
 
+    /* main measures native IPC before it starts on the rings */
+    ipc_serve(ipc_ep);
+
     receiver();
 
     return 0;
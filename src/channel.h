@@ -0,0 +1,117 @@
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+/*
+ * CHANNEL_DEFINE(name, slot_t, stride, forder, aorder, ftype, atype)
+ * generates the ring operations of one direction of the transport with the
+ * ring orders, the ring types, the slot type and the distance in bytes
+ * between slots fixed at compile time:
+ *
+ *   name_init(fring, aring, slots)  fill the free ring with [0, slots)
+ *   name_alloc(fring, idx, count, stats)  take up to count free slots
+ *   name_post(aring, idx, count, stats)   publish count filled slots
+ *   name_recv(aring, idx, count, stats)   take up to count published slots
+ *   name_free(fring, idx, count, stats)   return count slots to the free ring
+ *   name_slot(buf, idx)                   address of slot idx in a data buffer
+ *
+ * They behave like the ring_*() calls of ring.h, but call the functions of
+ * their ring types directly (RING_CHOOSE) instead of testing the type at
+ * run time, and pass the orders as constants that the inlined ring code
+ * folds. Slot addressing is a multiply by the constant stride, that is a
+ * shift. stats is the caller's struct ring_stats for the ring, or NULL.
+ */
+
+#define CHANNEL_DEFINE(name, slot_t, stride, forder, aorder, ftype, atype)          \
+_Static_assert(((stride) & ((stride) - 1)) == 0 && (stride) >= sizeof(slot_t),      \
+               #name ": slot stride must be a power of two that fits a slot");      \
+_Static_assert((forder) >= LFRING_MIN && (aorder) >= LFRING_MIN,                    \
+               #name ": ring order too small for the remap");                       \
+/* name_post() and name_free() count on the bounded rings never filling */          \
+_Static_assert((atype) == RING_LSCQ || (aorder) >= (forder),                        \
+               #name ": a bounded aring must hold every data slot");                \
+                                                                                    \
+static inline void name##_init(struct fring *f, struct aring *a, size_t slots) {    \
+    ring_init_fill(ftype, f->ring, 0, slots, forder);                               \
+    ring_init_empty(atype, a->ring, aorder);                                        \
+}                                                                                   \
+                                                                                    \
+static inline __attribute__((flatten)) size_t                                       \
+name##_alloc(struct fring *f, size_t *idx, size_t count,                            \
+             struct ring_stats *s) {                                                \
+    return RING_CHOOSE(ftype, dequeue_batch)(f->ring, forder, idx, count, s);       \
+}                                                                                   \
+                                                                                    \
+/* also orders the enqueue before the caller's doorbell check */                    \
+static inline __attribute__((flatten)) void                                         \
+name##_post(struct aring *a, const size_t *idx, size_t count,                       \
+            struct ring_stats *s) {                                                 \
+    RING_CHOOSE(atype, enqueue_batch)(a->ring, aorder, idx, count, s);              \
+    ring_doorbell_fence(atype);                                                     \
+}                                                                                   \
+                                                                                    \
+static inline __attribute__((flatten)) size_t                                       \
+name##_recv(struct aring *a, size_t *idx, size_t count,                             \
+            struct ring_stats *s) {                                                 \
+    return RING_CHOOSE(atype, dequeue_batch)(a->ring, aorder, idx, count, s);       \
+}                                                                                   \
+                                                                                    \
+/* also orders the enqueue before the caller's doorbell check */                    \
+static inline __attribute__((flatten)) void                                         \
+name##_free(struct fring *f, const size_t *idx, size_t count,                       \
+            struct ring_stats *s) {                                                 \
+    RING_CHOOSE(ftype, enqueue_batch)(f->ring, forder, idx, count, s);              \
+    ring_doorbell_fence(ftype);                                                     \
+}                                                                                   \
+                                                                                    \
+static inline slot_t *name##_slot(void *buf, size_t idx) {                          \
+    return (slot_t *)((char *)buf + idx * (stride));                                \
+}
+
+/*
+ * INLINE_CHANNEL_DEFINE(name, words, order) generates the same for a channel
+ * of inline messages (RING_INLINE, see inlring.h), whose aring carries the
+ * first words words of each message in place of a slot index:
+ *
+ *   name_init(fring, aring, slots)        empty the aring; there is no fring
+ *   name_space(aring, count)              room for up to count messages
+ *   name_send(aring, value, count, stats) publish count messages, all or none
+ *   name_recv(aring, value, count, stats) take up to count messages
+ *
+ * value holds count * words words, message after message.
+ */
+
+#define INLINE_CHANNEL_DEFINE(name, words, order)                                   \
+_Static_assert((order) >= LFRING_MIN, #name ": ring order too small");              \
+                                                                                    \
+static inline void name##_init(struct fring *f, struct aring *a, size_t slots) {    \
+    inlring_init((struct inlring *)a->ring, order);                                 \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_space(struct aring *a, size_t count) {                  \
+    return inlring_space((struct inlring *)a->ring, order, words, count);           \
+}                                                                                   \
+                                                                                    \
+/* also orders the enqueue before the caller's doorbell check */                    \
+static inline __attribute__((flatten)) bool                                         \
+name##_send(struct aring *a, const lfatomic_t *value, size_t count,                 \
+            struct ring_stats *s) {                                                 \
+    bool ok = inlring_enqueue_batch((struct inlring *)a->ring, order, words,        \
+                                    value, count);                                  \
+    atomic_thread_fence(memory_order_seq_cst);                                      \
+    return ok;                                                                      \
+}                                                                                   \
+                                                                                    \
+static inline __attribute__((flatten)) size_t                                       \
+name##_recv(struct aring *a, lfatomic_t *value, size_t count,                       \
+            struct ring_stats *s) {                                                 \
+    count = inlring_dequeue_batch((struct inlring *)a->ring, order, words,          \
+                                  value, count);                                    \
+    if (count != 0) {                                                               \
+        STAT_INC(s, ok);                                                            \
+    } else {                                                                        \
+        STAT_INC(s, empty);                                                         \
+    }                                                                               \
+    return count;                                                                   \
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef __CLIENT_H__
+#define __CLIENT_H__
+
+#include "doorbell.h"
+
+#include "counter.h"
+#include "histogram.h"
+
+/*
+ * Asynchronous requests over the request transport with a bounded window.
+ *
+ * client_submit() sends one request and returns straight away unless
+ * window requests are already in flight, in which case it sleeps until the
+ * oldest one completes. Word 0 of each request slot carries the request id,
+ * which app copies into its response. The thread receiving responses hands
+ * each one to client_complete(), which runs the callback given at submit
+ * time; responses come back in request order. If rtt is set, it also
+ * records the cycles from each submit to its completion there, or from
+ * the start time given to client_submit_at().
+ *
+ * Requests are committed to the ring batch at a time, and whatever is left
+ * over is committed by client_flush() or before the client goes to sleep.
+ *
+ * Only one thread may submit and only one may complete.
+ */
+
+#define CLIENT_MAX_WINDOW 512
+
+_Static_assert((CLIENT_MAX_WINDOW & (CLIENT_MAX_WINDOW - 1)) == 0,
+               "CLIENT_MAX_WINDOW must be a power of two");
+_Static_assert(CLIENT_MAX_WINDOW <= REQ_BUFFER_SIZE,
+               "the window must fit in the request data buffer");
+#ifdef RING_INLINE
+/* app answers without waiting for room, so the rsp aring must hold a window */
+_Static_assert(CLIENT_MAX_WINDOW <= RSP_BUFFER_SIZE,
+               "the window must fit in the rsp aring");
+#endif
+
+typedef void (*client_cb_t)(void *arg, const struct msg *rsp);
+
+struct client {
+    struct transport *tp;  /* sending end of the request channel */
+    doorbell_t ntfn;       /* notification the submitting thread sleeps on */
+    doorbell_t done;       /* doorbell the completing thread signals it with */
+    size_t window;
+    size_t batch;          /* requests per commit */
+    size_t staged;         /* requests written but not committed yet */
+    unsigned long issued;  /* requests submitted */
+    _Atomic(unsigned long) wake_at; /* completions the submitter waits for */
+    struct histogram *rtt; /* round-trip cycles of completed requests, or NULL */
+    /* written by the completing thread */
+    _Alignas(LF_CACHE_BYTES) _Atomic(unsigned long) completed;
+    struct {
+        client_cb_t cb;
+        void *arg;
+        uint64_t start;
+    } req[CLIENT_MAX_WINDOW];
+};
+
+static inline void client_init(struct client *c, struct transport *tp, doorbell_t ntfn,
+                               doorbell_t done, size_t window) {
+    assert(window > 0 && window <= CLIENT_MAX_WINDOW);
+
+    c->tp = tp;
+    c->ntfn = ntfn;
+    c->done = done;
+    c->window = window;
+    c->batch = 1;
+    c->staged = 0;
+    c->issued = 0;
+    c->rtt = NULL;
+    atomic_init(&c->wake_at, ~0UL);
+    atomic_init(&c->completed, 0);
+}
+
+static inline void client_flush(struct client *c) {
+    if (c->staged != 0) {
+        req_commit(c->tp, c->staged);
+        c->staged = 0;
+    }
+}
+
+/* sleep until count requests have completed */
+static inline void client_wait(struct client *c, unsigned long count) {
+    client_flush(c);
+    while ((long)(atomic_load(&c->completed) - count) < 0) {
+        atomic_store(&c->wake_at, count);
+        /* a completion may have come in before wake_at was set */
+        if ((long)(atomic_load(&c->completed) - count) >= 0) {
+            break;
+        }
+        doorbell_wait(c->ntfn);
+    }
+}
+
+/* sleep until every submitted request has completed */
+static inline void client_drain(struct client *c) {
+    client_wait(c, c->issued);
+}
+
+static inline void client_set_window(struct client *c, size_t window) {
+    assert(window > 0 && window <= CLIENT_MAX_WINDOW);
+    c->window = window;
+}
+
+static inline void client_set_batch(struct client *c, size_t batch) {
+    assert(batch > 0 && batch <= RING_BATCH);
+    client_flush(c);
+    c->batch = batch;
+}
+
+/* wait for room in the window and write msg into the next slot, returns the id */
+static inline unsigned long client_stage(struct client *c, const struct msg *msg,
+                                         client_cb_t cb, void *arg) {
+    unsigned long id = c->issued;
+    struct msg *slot;
+
+    /* wait only while the oldest request of the window is outstanding */
+    if (id >= c->window &&
+        (long)(atomic_load(&c->completed) - (id - c->window + 1)) < 0) {
+        client_wait(c, id - c->window + 1);
+    }
+    c->req[id & (CLIENT_MAX_WINDOW - 1)].cb = cb;
+    c->req[id & (CLIENT_MAX_WINDOW - 1)].arg = arg;
+
+    req_reserve(c->tp, c->staged + 1);
+    slot = req_next(c->tp, c->staged);
+    *slot = *msg;
+    slot->word[0] = id;
+    return id;
+}
+
+static inline void client_issue(struct client *c, unsigned long id, uint64_t start) {
+    c->req[id & (CLIENT_MAX_WINDOW - 1)].start = start;
+
+    c->issued = id + 1;
+    if (++c->staged == c->batch) {
+        client_flush(c);
+    }
+}
+
+/* word 0 of msg is overwritten with the request id, which is returned */
+static inline unsigned long client_submit(struct client *c, const struct msg *msg,
+                                          client_cb_t cb, void *arg) {
+    unsigned long id = client_stage(c, msg, cb, arg);
+    uint64_t start;
+
+    READ_COUNTER_BEFORE(start);
+    client_issue(c, id, start);
+    return id;
+}
+
+/*
+ * As client_submit(), but the round trip is timed from start, the time the
+ * request was meant to be sent, so that any wait for the window counts.
+ */
+static inline unsigned long client_submit_at(struct client *c, const struct msg *msg,
+                                             client_cb_t cb, void *arg, uint64_t start) {
+    unsigned long id = client_stage(c, msg, cb, arg);
+
+    client_issue(c, id, start);
+    return id;
+}
+
+static inline void client_complete(struct client *c, const struct msg *rsp) {
+    unsigned long id = rsp->word[0];
+    uint64_t now;
+
+    assert(id == atomic_load_explicit(&c->completed, memory_order_relaxed));
+    if (c->rtt != NULL) {
+        READ_COUNTER_AFTER(now);
+        hist_record(c->rtt, counter_elapsed(c->req[id & (CLIENT_MAX_WINDOW - 1)].start, now));
+    }
+    c->req[id & (CLIENT_MAX_WINDOW - 1)].cb(c->req[id & (CLIENT_MAX_WINDOW - 1)].arg, rsp);
+
+    if (atomic_fetch_add(&c->completed, 1) + 1 == atomic_load(&c->wake_at)) {
+        doorbell_signal(c->done);
+    }
+}
+
+#endif
@@ -1,28 +1,136 @@
 #ifndef __COUNTER_H__
 #define __COUNTER_H__
 
-#define READ_COUNTER_BEFORE(var) do { \
-    uint32_t low, high; \
-    asm volatile( \
-            "rdtscp \n" \
-            "movl %%edx, %0 \n" \
-            "movl %%eax, %1 \n" \
-            : "=r"(high), "=r"(low) \
-            : \
-            : "%rax", "%rbx", "%rcx", "%rdx"); \
-    (var) = (((uint64_t)high) << 32ull) | ((uint64_t)low); \
-} while (0)
-
-#define READ_COUNTER_AFTER(var) do { \
-    uint32_t low, high; \
-    asm volatile( \
-            "rdtscp \n" \
-            "movl %%edx, %0 \n" \
-            "movl %%eax, %1 \n" \
-            : "=r"(high), "=r"(low) \
-            : \
-            : "%rax", "rbx", "%rcx", "%rdx"); \
-    (var) = (((uint64_t)high) << 32ull) | ((uint64_t)low); \
-} while (0)
+#include <stdint.h>
+
+/*
+ * Cycle counter for timing a region of code:
+ *
+ *   READ_COUNTER_BEFORE(t0);
+ *   ...
+ *   READ_COUNTER_AFTER(t1);
+ *   cycles = counter_elapsed(t0, t1);
+ *
+ * On x86 the counter is the TSC. The start read is "lfence; rdtsc", which
+ * waits for earlier instructions to finish, and the stop read is "rdtscp;
+ * lfence", which waits for the timed code and keeps later code from
+ * starting early. On aarch64 it is the virtual counter, cntvct_el0, read
+ * between isb barriers; it ticks at a fixed frequency rather than per cycle.
+ *
+ * counter_init() measures the cost of a back-to-back start and stop read,
+ * which counter_elapsed() then subtracts, and finds the counter frequency
+ * for counter_ns(), so that results can be compared across machines.
+ */
+
+#define COUNTER_CALIBRATION_ROUNDS 1000
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static inline uint64_t counter_start(void) {
+    uint32_t low, high;
+
+    asm volatile("lfence\n\trdtsc" : "=a"(low), "=d"(high) : : "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t counter_stop(void) {
+    uint32_t low, high;
+
+    asm volatile("rdtscp\n\tlfence" : "=a"(low), "=d"(high) : : "ecx", "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+/* TSC frequency from CPUID leaf 0x15, or the base frequency from 0x16 */
+static inline uint64_t counter_arch_hz(void) {
+    uint32_t eax, ebx, ecx, edx, max;
+
+    asm volatile("cpuid" : "=a"(max), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+    if (max >= 0x15) {
+        asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x15), "c"(0));
+        if (eax != 0 && ebx != 0 && ecx != 0) {
+            return (uint64_t)ecx * ebx / eax;
+        }
+    }
+    if (max >= 0x16) {
+        asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x16), "c"(0));
+        if ((eax & 0xffff) != 0) {
+            return (uint64_t)(eax & 0xffff) * 1000000;
+        }
+    }
+    return 0;
+}
+
+#elif defined(__aarch64__)
+
+static inline uint64_t counter_start(void) {
+    uint64_t value;
+
+    asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(value) : : "memory");
+    return value;
+}
+
+static inline uint64_t counter_stop(void) {
+    uint64_t value;
+
+    asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(value) : : "memory");
+    return value;
+}
+
+static inline uint64_t counter_arch_hz(void) {
+    uint64_t hz;
+
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(hz));
+    return hz;
+}
+
+#else
+#error "no cycle counter for this architecture"
+#endif
+
+#define READ_COUNTER_BEFORE(var) ((var) = counter_start())
+#define READ_COUNTER_AFTER(var)  ((var) = counter_stop())
+
+struct counter_calibration {
+    uint64_t hz;       /* counter frequency, 0 if unknown */
+    uint64_t overhead; /* cost of a start read followed by a stop read */
+};
+
+static inline struct counter_calibration *counter_calibration(void) {
+    static struct counter_calibration calibration;
+
+    return &calibration;
+}
+
+static inline void counter_init(void) {
+    struct counter_calibration *c = counter_calibration();
+    uint64_t t0, t1, min = UINT64_MAX;
+
+    for (int i = 0; i < COUNTER_CALIBRATION_ROUNDS; i++) {
+        READ_COUNTER_BEFORE(t0);
+        READ_COUNTER_AFTER(t1);
+        if (t1 - t0 < min) {
+            min = t1 - t0;
+        }
+    }
+    c->overhead = min;
+    c->hz = counter_arch_hz();
+}
+
+/* counter ticks between two reads, less the cost of the reads themselves */
+static inline uint64_t counter_elapsed(uint64_t t0, uint64_t t1) {
+    uint64_t ticks = t1 - t0, overhead = counter_calibration()->overhead;
+
+    return ticks > overhead ? ticks - overhead : 0;
+}
+
+/* ticks in nanoseconds, or 0 if the frequency is unknown */
+static inline uint64_t counter_ns(uint64_t ticks) {
+    uint64_t hz = counter_calibration()->hz;
+
+    if (hz == 0) {
+        return 0;
+    }
+    return ticks / hz * 1000000000 + ticks % hz * 1000000000 / hz;
+}
 
 #endif
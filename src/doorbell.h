@@ -0,0 +1,76 @@
+#ifndef __DOORBELL_H__
+#define __DOORBELL_H__
+
+/*
+ * The wakeups the transport and the client sleep on and signal with.
+ *
+ * On seL4 a doorbell is a notification cap: doorbell_signal() is
+ * seL4_Signal() and doorbell_wait() is seL4_Wait(), and a badged cap ORs its
+ * badge into the notification word.
+ *
+ * Built with RING_HOST for Linux, a doorbell names a 32-bit word in memory
+ * shared by the two sides, plus the badge it ORs in. doorbell_wait() takes
+ * the whole word and sleeps on a futex while it is zero, so several
+ * doorbells may share one word just as several badged caps share one
+ * notification. The futex is not private, so the word may sit in memory
+ * mapped by more than one process.
+ */
+
+#ifdef RING_HOST
+
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+typedef struct {
+    _Atomic(uint32_t) *word;
+    uint32_t badge;
+} doorbell_t;
+
+#define DOORBELL_NULL ((doorbell_t){ NULL, 0 })
+
+static inline void doorbell_signal(doorbell_t d) {
+    assert(d.word != NULL && d.badge != 0);
+    if (atomic_fetch_or(d.word, d.badge) == 0) {
+        syscall(SYS_futex, d.word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+/* returns the badges signalled since the last wait, like seL4_Wait() */
+static inline uint32_t doorbell_wait(doorbell_t d) {
+    uint32_t badges;
+
+    assert(d.word != NULL);
+    while ((badges = atomic_exchange(d.word, 0)) == 0) {
+        /* returns at once if a signal came in after the exchange */
+        syscall(SYS_futex, d.word, FUTEX_WAIT, 0, NULL, NULL, 0);
+    }
+    return badges;
+}
+
+#else
+
+#include <sel4/sel4.h>
+
+typedef seL4_CPtr doorbell_t;
+
+#define DOORBELL_NULL seL4_CapNull
+
+static inline void doorbell_signal(doorbell_t d) {
+    seL4_Signal(d);
+}
+
+static inline seL4_Word doorbell_wait(doorbell_t d) {
+    seL4_Word badge;
+
+    seL4_Wait(d, &badge);
+    return badge;
+}
+
+#endif
+
+#endif
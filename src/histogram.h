@@ -0,0 +1,100 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * A log-bucketed histogram in the style of HdrHistogram. Values below
+ * HIST_SUB get a bucket each; above that every power of two is split into
+ * HIST_SUB buckets, so a bucket is never wider than 1/HIST_SUB of the
+ * values it holds. All buckets are preallocated and hist_record() is a
+ * count-leading-zeros, a shift and two adds.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1U << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+struct histogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t bucket[HIST_BUCKETS];
+};
+
+static inline unsigned hist_index(uint64_t value) {
+    unsigned shift;
+
+    if (value < HIST_SUB) {
+        return value;
+    }
+    shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (unsigned)(value >> shift) - HIST_SUB;
+}
+
+/* smallest value that falls into bucket i */
+static inline uint64_t hist_bucket_low(unsigned i) {
+    unsigned shift;
+
+    if (i < HIST_SUB) {
+        return i;
+    }
+    shift = (i >> HIST_SUB_BITS) - 1;
+    return (uint64_t)((i & (HIST_SUB - 1)) + HIST_SUB) << shift;
+}
+
+static inline void hist_init(struct histogram *h) {
+    h->count = 0;
+    h->max = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        h->bucket[i] = 0;
+    }
+}
+
+static inline void hist_record(struct histogram *h, uint64_t value) {
+    h->bucket[hist_index(value)]++;
+    h->count++;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/*
+ * Value below which ppm parts per million of the recorded values fall,
+ * reported as the top of its bucket.
+ */
+static inline uint64_t hist_percentile(const struct histogram *h, uint64_t ppm) {
+    uint64_t rank = (h->count * ppm + 999999) / 1000000;
+    uint64_t seen = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            uint64_t top = i + 1 < HIST_BUCKETS ? hist_bucket_low(i + 1) - 1 : UINT64_MAX;
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+/*
+ * Print the percentiles on one line, then one "hist <name> <low> <count>"
+ * line for every non-empty bucket, for scripts to pick up.
+ */
+static inline void hist_print(const struct histogram *h, const char *name) {
+    printf("%s: count %lu p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n", name,
+        (unsigned long)h->count,
+        (unsigned long)hist_percentile(h, 500000), (unsigned long)hist_percentile(h, 900000),
+        (unsigned long)hist_percentile(h, 990000), (unsigned long)hist_percentile(h, 999000),
+        (unsigned long)h->max);
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        if (h->bucket[i] != 0) {
+            printf("hist %s %lu %lu\n", name, (unsigned long)hist_bucket_low(i),
+                (unsigned long)h->bucket[i]);
+        }
+    }
+}
+
+#endif
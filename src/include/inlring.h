@@ -0,0 +1,130 @@
+/*
+ * A single-producer/single-consumer ring of inline messages.
+ *
+ * Where the other rings carry indices of data slots, each entry here
+ * carries one payload word next to a cycle tag, 2 * sizeof(lfatomic_t)
+ * bytes in all, and a message of w words takes w consecutive entries. A
+ * ring of order o has 2^o entries and fits in INLRING_SIZE(o) bytes with
+ * at most LFRING_ALIGN alignment, so it can be placed wherever an lfring
+ * is.
+ *
+ * The tag of the entry at position p is p + 1 once the producer has
+ * written it, stored with release ordering after the payload, so the
+ * consumer never reads the producer's tail: it loads the tag of the last
+ * entry of the next message and takes the message if the tag belongs to
+ * this cycle. Only the consumer's head is shared, and the producer reads it
+ * only when its cached copy says the ring is full. With one producer and
+ * one consumer the tag and payload need no double-width CAS.
+ */
+
+#ifndef __INLRING_H
+#define __INLRING_H	1
+
+#include "lfring.h"
+
+#define INLRING_SIZE(o)	\
+	(offsetof(struct __inlring, array) + (sizeof(struct __inlring_entry) << (o)))
+
+struct __inlring_entry {
+	_Alignas(2 * sizeof(lfatomic_t)) LFATOMIC(lfatomic_t) tag;
+	lfatomic_t value;
+};
+
+struct __inlring {
+	/* consumer side */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_t) head;
+	/* producer side */
+	_Alignas(LF_CACHE_BYTES) lfatomic_t tail;
+	lfatomic_t head_cache;
+	_Alignas(LF_CACHE_BYTES) struct __inlring_entry array[1];
+};
+
+struct inlring;
+
+_Static_assert(_Alignof(struct __inlring) <= LFRING_ALIGN,
+	"inlring must fit wherever an lfring does");
+
+static inline void inlring_init(struct inlring * ring, size_t order)
+{
+	struct __inlring * q = (struct __inlring *) ring;
+	size_t i, n = lfring_pow2(order);
+
+	for (i = 0; i != n; i++) {
+		atomic_init(&q->array[i].tag, 0);
+		q->array[i].value = 0;
+	}
+
+	atomic_init(&q->head, 0);
+	q->tail = 0;
+	q->head_cache = 0;
+}
+
+/*
+ * Room for up to count messages of words words each. Only the producer may
+ * ask, and the head is read only if the cached copy leaves less than that.
+ */
+static inline size_t inlring_space(struct inlring * ring, size_t order,
+		size_t words, size_t count)
+{
+	struct __inlring * q = (struct __inlring *) ring;
+	size_t n = lfring_pow2(order), free = n - (q->tail - q->head_cache);
+
+	if (free < count * words) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		free = n - (q->tail - q->head_cache);
+	}
+	free /= words;
+	return free < count ? free : count;
+}
+
+/* Enqueue count messages of words words each, all of them or none. */
+static inline bool inlring_enqueue_batch(struct inlring * ring, size_t order,
+		size_t words, const lfatomic_t * value, size_t count)
+{
+	struct __inlring * q = (struct __inlring *) ring;
+	size_t i, n = lfring_pow2(order), total = count * words;
+	lfatomic_t tail = q->tail;
+	struct __inlring_entry * e;
+
+	if (tail + total - q->head_cache > n) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail + total - q->head_cache > n)
+			return false;
+	}
+
+	for (i = 0; i != total; i++) {
+		e = &q->array[(tail + i) & (n - 1)];
+		e->value = value[i];
+		atomic_store_explicit(&e->tag, tail + i + 1, memory_order_release);
+	}
+	q->tail = tail + total;
+	return true;
+}
+
+/* Dequeue up to count whole messages of words words each. */
+static inline size_t inlring_dequeue_batch(struct inlring * ring,
+		size_t order, size_t words, lfatomic_t * value, size_t count)
+{
+	struct __inlring * q = (struct __inlring *) ring;
+	size_t i, k, n = lfring_pow2(order);
+	lfatomic_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	lfatomic_t last;
+
+	for (i = 0; i != count; i++) {
+		/* Tags are published in order, so the last one covers the message. */
+		last = head + i * words + words - 1;
+		if (atomic_load_explicit(&q->array[last & (n - 1)].tag,
+				memory_order_acquire) != last + 1)
+			break;
+		for (k = 0; k != words; k++)
+			value[i * words + k] =
+				q->array[(head + i * words + k) & (n - 1)].value;
+	}
+	if (i != 0)
+		atomic_store_explicit(&q->head, head + i * words, memory_order_release);
+	return i;
+}
+
+#endif	/* !__INLRING_H */
+
+/* vi: set tabstop=4: */
@@ -50,6 +50,24 @@
 
 #define LFRING_EMPTY	(~(size_t) 0U)
 
+/*
+ * Event counters, compiled in with LFRING_STATS. The functions taking a
+ * struct lfring_stats * accept NULL; without LFRING_STATS the argument is
+ * ignored.
+ */
+#ifdef LFRING_STATS
+struct lfring_stats {
+	unsigned long retries;		/* failed CAS and skipped positions */
+	unsigned long catchups;		/* __lfring_catchup() calls */
+	unsigned long exhausted;	/* dequeues that ran out of threshold */
+};
+# define __lfring_stat(stats, field)	\
+	((stats) != NULL ? (void) (stats)->field++ : (void) 0)
+#else
+struct lfring_stats;
+# define __lfring_stat(stats, field)	((void) 0)
+#endif
+
 #define __lfring_cmp(x, op, y)	((lfsatomic_t) ((x) - (y)) op 0)
 
 #if LFRING_MIN != 0
@@ -132,44 +150,98 @@ static inline void lfring_init_fill(struct lfring * ring,
 	atomic_init(&q->tail, e);
 }
 
-static inline bool lfring_enqueue(struct lfring * ring, size_t order,
-		size_t eidx, bool nonempty)
+static inline bool __lfring_enqueue_slot(struct __lfring * q, size_t order,
+		size_t n, lfatomic_t tail, size_t eidx, struct lfring_stats * stats)
 {
-	struct __lfring * q = (struct __lfring *) ring;
-	size_t tidx, half = lfring_pow2(order), n = half * 2;
-	lfatomic_t tail, entry, ecycle, tcycle;
-
-	eidx ^= (n - 1);
+	size_t tidx = __lfring_map(tail, order, n);
+	lfatomic_t entry, ecycle, tcycle = (tail << 1) | (2 * n - 1);
 
-	while (1) {
-		tail = atomic_fetch_add_explicit(&q->tail, 1, memory_order_acq_rel);
-		tcycle = (tail << 1) | (2 * n - 1);
-		tidx = __lfring_map(tail, order, n);
-		entry = atomic_load_explicit(&q->array[tidx], memory_order_acquire);
-retry:
+	entry = atomic_load_explicit(&q->array[tidx], memory_order_acquire);
+	do {
 		ecycle = entry | (2 * n - 1);
-		if (__lfring_cmp(ecycle, <, tcycle) && ((entry == ecycle) ||
+		if (!(__lfring_cmp(ecycle, <, tcycle) && ((entry == ecycle) ||
 				((entry == (ecycle ^ n)) &&
 				 __lfring_cmp(atomic_load_explicit(&q->head,
-				  memory_order_acquire), <=, tail)))) {
+				  memory_order_acquire), <=, tail)))))
+			return false;
+	} while (!atomic_compare_exchange_weak_explicit(&q->array[tidx],
+			&entry, tcycle ^ eidx,
+			memory_order_acq_rel, memory_order_acquire) &&
+			(__lfring_stat(stats, retries), true));
+
+	return true;
+}
 
-			if (!atomic_compare_exchange_weak_explicit(&q->array[tidx],
-					&entry, tcycle ^ eidx,
-					memory_order_acq_rel, memory_order_acquire))
-				goto retry;
+static inline bool __lfring_enqueue(struct lfring * ring, size_t order,
+		size_t eidx, bool nonempty, struct lfring_stats * stats)
+{
+	struct __lfring * q = (struct __lfring *) ring;
+	size_t half = lfring_pow2(order), n = half * 2;
+	lfatomic_t tail;
+
+	eidx ^= (n - 1);
 
+	while (1) {
+		tail = atomic_fetch_add_explicit(&q->tail, 1, memory_order_acq_rel);
+		if (__lfring_enqueue_slot(q, order, n, tail, eidx, stats)) {
 			if (!nonempty && (atomic_load(&q->threshold) != __lfring_threshold3(half, n)))
 				atomic_store(&q->threshold, __lfring_threshold3(half, n));
 			return true;
 		}
+		__lfring_stat(stats, retries);
+	}
+}
+
+static inline bool lfring_enqueue(struct lfring * ring, size_t order,
+		size_t eidx, bool nonempty)
+{
+	return __lfring_enqueue(ring, order, eidx, nonempty, NULL);
+}
+
+/*
+ * Enqueue count indices with a single fetch-add on the tail. Every reserved
+ * position is tried in order; positions that turn out to be unusable are
+ * simply skipped (as lfring_enqueue does) and whatever does not fit is
+ * enqueued one position at a time.
+ */
+static inline void lfring_enqueue_batch(struct lfring * ring, size_t order,
+		const size_t * eidx, size_t count, bool nonempty,
+		struct lfring_stats * stats)
+{
+	struct __lfring * q = (struct __lfring *) ring;
+	size_t i = 0, k, half = lfring_pow2(order), n = half * 2;
+	lfatomic_t tail;
+
+	if (count == 0)
+		return;
+
+	tail = atomic_fetch_add_explicit(&q->tail, count, memory_order_acq_rel);
+	for (k = 0; k != count; k++, tail++) {
+		if (__lfring_enqueue_slot(q, order, n, tail, eidx[i] ^ (n - 1), stats))
+			i++;
+		else
+			__lfring_stat(stats, retries);
 	}
+
+	while (i != count) {
+		tail = atomic_fetch_add_explicit(&q->tail, 1, memory_order_acq_rel);
+		if (__lfring_enqueue_slot(q, order, n, tail, eidx[i] ^ (n - 1), stats))
+			i++;
+		else
+			__lfring_stat(stats, retries);
+	}
+
+	if (!nonempty && (atomic_load(&q->threshold) != __lfring_threshold3(half, n)))
+		atomic_store(&q->threshold, __lfring_threshold3(half, n));
 }
 
 static inline void __lfring_catchup(struct lfring * ring,
-	lfatomic_t tail, lfatomic_t head)
+	lfatomic_t tail, lfatomic_t head, struct lfring_stats * stats)
 {
 	struct __lfring * q = (struct __lfring *) ring;
 
+	__lfring_stat(stats, catchups);
+
 	while (!atomic_compare_exchange_weak_explicit(&q->tail, &tail, head,
 			memory_order_acq_rel, memory_order_acquire)) {
 		head = atomic_load_explicit(&q->head, memory_order_acquire);
@@ -179,57 +251,130 @@ static inline void __lfring_catchup(struct lfring * ring,
 	}
 }
 
-static inline size_t lfring_dequeue(struct lfring * ring, size_t order,
-		bool nonempty)
+static inline bool __lfring_dequeue_slot(struct __lfring * q, size_t order,
+		size_t n, lfatomic_t head, size_t * eidx, struct lfring_stats * stats)
+{
+	size_t hidx = __lfring_map(head, order, n);
+	lfatomic_t entry, entry_new, ecycle, hcycle = (head << 1) | (2 * n - 1);
+
+	entry = atomic_load_explicit(&q->array[hidx], memory_order_acquire);
+	do {
+		ecycle = entry | (2 * n - 1);
+		if (ecycle == hcycle) {
+			atomic_fetch_or_explicit(&q->array[hidx], (n - 1),
+					memory_order_acq_rel);
+			*eidx = (size_t) (entry & (n - 1));
+			return true;
+		}
+
+		if ((entry | n) != ecycle) {
+			entry_new = entry & ~(lfatomic_t) n;
+			if (entry == entry_new)
+				break;
+		} else {
+			entry_new = hcycle ^ ((~entry) & n);
+		}
+	} while (__lfring_cmp(ecycle, <, hcycle) &&
+				!atomic_compare_exchange_weak_explicit(&q->array[hidx],
+				&entry, entry_new,
+				memory_order_acq_rel, memory_order_acquire) &&
+				(__lfring_stat(stats, retries), true));
+
+	return false;
+}
+
+static inline size_t __lfring_dequeue(struct lfring * ring, size_t order,
+		bool nonempty, struct lfring_stats * stats)
 {
 	struct __lfring * q = (struct __lfring *) ring;
-	size_t hidx, n = lfring_pow2(order + 1);
-	lfatomic_t head, entry, entry_new, ecycle, hcycle, tail;
+	size_t eidx, n = lfring_pow2(order + 1);
+	lfatomic_t head, tail;
 
 	if (!nonempty && atomic_load_explicit(&q->threshold, memory_order_acquire) < 0) {
+		__lfring_stat(stats, exhausted);
 		return LFRING_EMPTY;
 	}
 
 	while (1) {
 		head = atomic_fetch_add_explicit(&q->head, 1, memory_order_acq_rel);
-		hcycle = (head << 1) | (2 * n - 1);
-		hidx = __lfring_map(head, order, n);
-		entry = atomic_load_explicit(&q->array[hidx], memory_order_acquire);
-
-		do {
-			ecycle = entry | (2 * n - 1);
-			if (ecycle == hcycle) {
-				atomic_fetch_or_explicit(&q->array[hidx], (n - 1),
-						memory_order_acq_rel);
-				return (size_t) (entry & (n - 1));
-			}
-
-			if ((entry | n) != ecycle) {
-				entry_new = entry & ~(lfatomic_t) n;
-				if (entry == entry_new)
-					break;
-			} else {
-				entry_new = hcycle ^ ((~entry) & n);
-			}
-		} while (__lfring_cmp(ecycle, <, hcycle) &&
-					!atomic_compare_exchange_weak_explicit(&q->array[hidx],
-					&entry, entry_new,
-					memory_order_acq_rel, memory_order_acquire));
+		if (__lfring_dequeue_slot(q, order, n, head, &eidx, stats))
+			return eidx;
 
 		if (!nonempty) {
 			tail = atomic_load_explicit(&q->tail, memory_order_acquire);
 			if (__lfring_cmp(tail, <=, head + 1)) {
-				__lfring_catchup(ring, tail, head + 1);
+				__lfring_catchup(ring, tail, head + 1, stats);
 				atomic_fetch_sub_explicit(&q->threshold, 1,
 					memory_order_acq_rel);
 				return LFRING_EMPTY;
 			}
 
 			if (atomic_fetch_sub_explicit(&q->threshold, 1,
-					memory_order_acq_rel) <= 0)
+					memory_order_acq_rel) <= 0) {
+				__lfring_stat(stats, exhausted);
 				return LFRING_EMPTY;
+			}
 		}
+		__lfring_stat(stats, retries);
+	}
+}
+
+static inline size_t lfring_dequeue(struct lfring * ring, size_t order,
+		bool nonempty)
+{
+	return __lfring_dequeue(ring, order, nonempty, NULL);
+}
+
+/*
+ * Dequeue up to count indices into eidx[] with a single fetch-add on the
+ * head and return how many were actually obtained. The number of reserved
+ * positions is capped by the current tail - head distance, so an idle ring
+ * costs no more than a regular lfring_dequeue. A return value of 0 means
+ * the ring looked empty.
+ */
+static inline size_t lfring_dequeue_batch(struct lfring * ring, size_t order,
+		size_t * eidx, size_t count, bool nonempty,
+		struct lfring_stats * stats)
+{
+	struct __lfring * q = (struct __lfring *) ring;
+	size_t i, got = 0, n = lfring_pow2(order + 1);
+	lfatomic_t head, tail;
+	lfsatomic_t avail;
+
+	if (!nonempty && atomic_load_explicit(&q->threshold, memory_order_acquire) < 0) {
+		__lfring_stat(stats, exhausted);
+		return 0;
+	}
+
+	head = atomic_load_explicit(&q->head, memory_order_acquire);
+	tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+	avail = (lfsatomic_t) (tail - head);
+	if (avail <= 1 || count <= 1) {
+		if (count == 0 || (eidx[0] = __lfring_dequeue(ring, order,
+				nonempty, stats)) == LFRING_EMPTY)
+			return 0;
+		return 1;
+	}
+	if ((size_t) avail < count)
+		count = (size_t) avail;
+
+	head = atomic_fetch_add_explicit(&q->head, count, memory_order_acq_rel);
+	for (i = 0; i != count; i++) {
+		if (__lfring_dequeue_slot(q, order, n, head + i, &eidx[got], stats))
+			got++;
+		else
+			__lfring_stat(stats, retries);
 	}
+
+	if (!nonempty && got != count) {
+		tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (__lfring_cmp(tail, <=, head + count))
+			__lfring_catchup(ring, tail, head + count, stats);
+		atomic_fetch_sub_explicit(&q->threshold, count - got,
+			memory_order_acq_rel);
+	}
+
+	return got;
 }
 
 #endif	/* !__LFRING_H */
@@ -0,0 +1,229 @@
+/*
+ * An unbounded LSCQ queue of indices (DISC '19): SCQ rings from lfring.h
+ * chained with the markable M&S queue from lfqueue.h.
+ *
+ * Each segment is an SCQ pair: a data array of 2^o entries plus an
+ * allocated (aq) and a free (fq) ring of positions in it, so the values
+ * queued are not limited to o bits and a segment is full once fq runs dry.
+ *
+ * When the tail segment fills up, it is closed and the producer links a
+ * fresh segment taken from a pool that is carved out of the same memory
+ * block; the consumer hands drained segments back to the pool. Segments are
+ * linked by pointer, so a queue shared between address spaces must be
+ * mapped at the same address in all of them.
+ *
+ * Both the segment and the pool order must be at least LFRING_MIN.
+ * Any number of threads may enqueue. lscq_dequeue() must only be called by
+ * one consumer at a time, as it is the one retiring drained segments.
+ */
+
+#ifndef __LSCQ_H
+#define __LSCQ_H	1
+
+#include "lfring.h"
+#include "lfqueue.h"
+
+struct __lscq_seg {
+	struct lfqueue_node node;
+	/* producers currently inside this segment */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(long) users;
+	LFATOMIC(bool) finalized;
+	/* aq, fq and the data array */
+	_Alignas(LFRING_ALIGN) char rings[0];
+};
+
+struct __lscq {
+	struct lfqueue list;
+	/* free segment indices */
+	_Alignas(LFRING_ALIGN) char pool[0];
+};
+
+#define __LSCQ_ROUND(x)	\
+	(((x) + LFRING_ALIGN - 1) & ~((size_t) LFRING_ALIGN - 1))
+#define __LSCQ_SEG_SIZE(o)	\
+	__LSCQ_ROUND(offsetof(struct __lscq_seg, rings) +	\
+		2 * __LSCQ_ROUND(LFRING_SIZE(o)) + (sizeof(size_t) << (o)))
+#define __LSCQ_SEGS(po)	\
+	__LSCQ_ROUND(offsetof(struct __lscq, pool) + LFRING_SIZE(po))
+
+/* A queue of order o segments with a pool of 2^po of them. */
+#define LSCQ_ALIGN	LFRING_ALIGN
+#define LSCQ_SIZE(o, po)	\
+	(__LSCQ_SEGS(po) + (__LSCQ_SEG_SIZE(o) << (po)))
+
+struct lscq;
+
+static inline struct lfring *__lscq_aq(struct __lscq_seg * seg)
+{
+	return (struct lfring *) seg->rings;
+}
+
+static inline struct lfring *__lscq_fq(struct __lscq_seg * seg, size_t order)
+{
+	return (struct lfring *) (seg->rings + __LSCQ_ROUND(LFRING_SIZE(order)));
+}
+
+static inline size_t *__lscq_data(struct __lscq_seg * seg, size_t order)
+{
+	return (size_t *) (seg->rings + 2 * __LSCQ_ROUND(LFRING_SIZE(order)));
+}
+
+static inline struct __lscq_seg *__lscq_seg(struct __lscq * q, size_t order,
+		size_t pool_order, size_t i)
+{
+	return (struct __lscq_seg *) ((char *) q + __LSCQ_SEGS(pool_order) +
+			i * __LSCQ_SEG_SIZE(order));
+}
+
+static inline void __lscq_seg_reset(struct __lscq_seg * seg, size_t order)
+{
+	lfring_init_empty(__lscq_aq(seg), order);
+	lfring_init_fill(__lscq_fq(seg, order), 0, lfring_pow2(order), order);
+	atomic_store(&seg->finalized, false);
+}
+
+static inline struct __lscq_seg *__lscq_seg_alloc(struct __lscq * q,
+		size_t order, size_t pool_order)
+{
+	struct __lscq_seg * seg;
+	size_t i;
+
+	i = lfring_dequeue((struct lfring *) q->pool, pool_order, false);
+	if (i == LFRING_EMPTY)
+		return NULL;
+
+	seg = __lscq_seg(q, order, pool_order, i);
+	__lscq_seg_reset(seg, order);
+	return seg;
+}
+
+static inline void __lscq_seg_free(struct __lscq * q, size_t pool_order,
+		struct __lscq_seg * seg)
+{
+	lfring_enqueue((struct lfring *) q->pool, pool_order, seg->node.index,
+		false);
+}
+
+static inline bool __lscq_seg_enqueue(struct __lscq_seg * seg, size_t order,
+		size_t eidx)
+{
+	size_t pos = lfring_dequeue(__lscq_fq(seg, order), order, false);
+
+	if (pos == LFRING_EMPTY)
+		return false;
+	__lscq_data(seg, order)[pos] = eidx;
+	lfring_enqueue(__lscq_aq(seg), order, pos, false);
+	return true;
+}
+
+static inline size_t __lscq_seg_dequeue(struct __lscq_seg * seg, size_t order)
+{
+	size_t eidx, pos = lfring_dequeue(__lscq_aq(seg), order, false);
+
+	if (pos == LFRING_EMPTY)
+		return LFRING_EMPTY;
+	eidx = __lscq_data(seg, order)[pos];
+	lfring_enqueue(__lscq_fq(seg, order), order, pos, false);
+	return eidx;
+}
+
+static inline void lscq_init(struct lscq * ring, size_t order,
+		size_t pool_order)
+{
+	struct __lscq * q = (struct __lscq *) ring;
+	lfatomic_aba_t null = { .stamp = 0, .value = __LFQ_NULL };
+	struct __lscq_seg * seg;
+	size_t i, n = lfring_pow2(pool_order);
+
+	for (i = 0; i != n; i++) {
+		seg = __lscq_seg(q, order, pool_order, i);
+		__lfaba_init(&seg->node.next, null);
+		seg->node.object = NULL;
+		seg->node.index = i;
+		atomic_init(&seg->users, 0);
+		atomic_init(&seg->finalized, false);
+	}
+
+	/* segment 0 starts out as both the head and the tail */
+	seg = __lscq_seg(q, order, pool_order, 0);
+	__lscq_seg_reset(seg, order);
+	lfring_init_fill((struct lfring *) q->pool, 1, n, pool_order);
+	lfqueue_init(&q->list, &seg->node);
+}
+
+static inline struct __lscq_seg *__lscq_tail(struct __lscq * q)
+{
+	return (struct __lscq_seg *) __lfaba_load_value(&q->list.tail,
+			memory_order_acquire);
+}
+
+/* Fails only if the pool has no segment left to link. */
+static inline bool lscq_enqueue(struct lscq * ring, size_t order,
+		size_t pool_order, size_t eidx)
+{
+	struct __lscq * q = (struct __lscq *) ring;
+	struct __lscq_seg * seg, * next;
+	bool finalized;
+
+	while (1) {
+		seg = __lscq_tail(q);
+		atomic_fetch_add(&seg->users, 1);
+		/* the segment may have been retired before users went up */
+		finalized = atomic_load(&seg->finalized);
+		if (seg == __lscq_tail(q) && !finalized) {
+			if (__lscq_seg_enqueue(seg, order, eidx)) {
+				atomic_fetch_sub(&seg->users, 1);
+				return true;
+			}
+			atomic_store(&seg->finalized, true);
+			finalized = true;
+		}
+		atomic_fetch_sub(&seg->users, 1);
+		if (!finalized || seg != __lscq_tail(q))
+			continue;
+
+		/* the tail segment is closed: open a new one */
+		next = __lscq_seg_alloc(q, order, pool_order);
+		if (next == NULL)
+			return false;
+		__lscq_seg_enqueue(next, order, eidx);
+		lfqueue_enqueue(&q->list, &next->node, false);
+		return true;
+	}
+}
+
+static inline size_t lscq_dequeue(struct lscq * ring, size_t order,
+		size_t pool_order)
+{
+	struct __lscq * q = (struct __lscq *) ring;
+	struct __lscq_seg * seg;
+	size_t eidx;
+
+	while (1) {
+		seg = (struct __lscq_seg *) lfqueue_sentinel(&q->list);
+		eidx = __lscq_seg_dequeue(seg, order);
+		/*
+		 * Two producers may link a segment each, leaving the first one
+		 * behind the tail without ever being finalized.
+		 */
+		if (eidx != LFRING_EMPTY || (!atomic_load(&seg->finalized) &&
+				seg == __lscq_tail(q)))
+			return eidx;
+
+		/* closed, but a producer may still be completing an enqueue */
+		if (atomic_load(&seg->users) != 0)
+			return LFRING_EMPTY;
+		eidx = __lscq_seg_dequeue(seg, order);
+		if (eidx != LFRING_EMPTY)
+			return eidx;
+
+		/* drained for good: move on once the next segment is linked */
+		if (lfqueue_dequeue(&q->list, false) == NULL)
+			return LFRING_EMPTY;
+		__lscq_seg_free(q, pool_order, seg);
+	}
+}
+
+#endif	/* !__LSCQ_H */
+
+/* vi: set tabstop=4: */
@@ -0,0 +1,157 @@
+/*
+ * A single-producer/single-consumer ring of indices.
+ *
+ * It follows the lfring contract: a ring of order o carries indices in
+ * [0, 2^o), fits in LFRING_SIZE(o) bytes with LFRING_ALIGN alignment and
+ * reports LFRING_EMPTY when there is nothing to dequeue, so it can be
+ * placed wherever an lfring is. Each side only writes its own index and
+ * keeps a cached copy of the remote one, so the fast path is made of plain
+ * loads and release stores; no read-modify-write atomics are used.
+ */
+
+#ifndef __SPSCRING_H
+#define __SPSCRING_H	1
+
+#include "lfring.h"
+
+#define SPSCRING_SIZE(o)	\
+	(offsetof(struct __spscring, array) + (sizeof(lfatomic_t) << (o)))
+
+struct __spscring {
+	/* consumer side */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_t) head;
+	lfatomic_t tail_cache;
+	/* producer side */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_t) tail;
+	lfatomic_t head_cache;
+	_Alignas(LF_CACHE_BYTES) lfatomic_t array[1];
+};
+
+struct spscring;
+
+/*
+ * Event counters, compiled in with LFRING_STATS as lfring's are. An SPSC
+ * ring has no CAS to retry and no threshold to run out of; what costs is
+ * pulling in the other side's cache line, which each side only does when
+ * its cached copy of the other's index says the ring is full or empty.
+ * The batch functions taking a struct spscring_stats * accept NULL.
+ */
+#ifdef LFRING_STATS
+struct spscring_stats {
+	unsigned long refreshes;	/* reloads of the other side's index */
+};
+# define __spscring_stat(stats, field)	\
+	((stats) != NULL ? (void) (stats)->field++ : (void) 0)
+#else
+struct spscring_stats;
+# define __spscring_stat(stats, field)	((void) 0)
+#endif
+
+_Static_assert(_Alignof(struct __spscring) <= LFRING_ALIGN,
+	"spscring must fit wherever an lfring does");
+
+static inline void spscring_init_fill(struct spscring * ring,
+		size_t s, size_t e, size_t order)
+{
+	struct __spscring * q = (struct __spscring *) ring;
+	size_t i, n = lfring_pow2(order);
+
+	for (i = s; i != e; i++)
+		q->array[__lfring_raw_map(i, order, n)] = i;
+
+	atomic_init(&q->head, s);
+	atomic_init(&q->tail, e);
+	q->tail_cache = e;
+	q->head_cache = s;
+}
+
+static inline void spscring_init_empty(struct spscring * ring, size_t order)
+{
+	spscring_init_fill(ring, 0, 0, order);
+}
+
+static inline bool spscring_enqueue(struct spscring * ring, size_t order,
+		size_t eidx)
+{
+	struct __spscring * q = (struct __spscring *) ring;
+	size_t n = lfring_pow2(order);
+	lfatomic_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if (tail - q->head_cache >= n) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail - q->head_cache >= n)
+			return false;
+	}
+
+	q->array[__lfring_raw_map(tail, order, n)] = eidx;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+/*
+ * Enqueue all count indices, or none if they do not fit. A ring of order o
+ * that only ever carries indices in [0, 2^o) always has room.
+ */
+static inline bool spscring_enqueue_batch(struct spscring * ring,
+		size_t order, const size_t * eidx, size_t count,
+		struct spscring_stats * stats)
+{
+	struct __spscring * q = (struct __spscring *) ring;
+	size_t i, n = lfring_pow2(order);
+	lfatomic_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if (tail + count - q->head_cache > n) {
+		__spscring_stat(stats, refreshes);
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail + count - q->head_cache > n)
+			return false;
+	}
+
+	for (i = 0; i != count; i++)
+		q->array[__lfring_raw_map(tail + i, order, n)] = eidx[i];
+	atomic_store_explicit(&q->tail, tail + count, memory_order_release);
+	return true;
+}
+
+static inline size_t spscring_dequeue(struct spscring * ring, size_t order)
+{
+	struct __spscring * q = (struct __spscring *) ring;
+	size_t eidx, n = lfring_pow2(order);
+	lfatomic_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (head == q->tail_cache) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tail_cache)
+			return LFRING_EMPTY;
+	}
+
+	eidx = q->array[__lfring_raw_map(head, order, n)];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return eidx;
+}
+
+static inline size_t spscring_dequeue_batch(struct spscring * ring,
+		size_t order, size_t * eidx, size_t count,
+		struct spscring_stats * stats)
+{
+	struct __spscring * q = (struct __spscring *) ring;
+	size_t i, n = lfring_pow2(order);
+	lfatomic_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (q->tail_cache - head < count) {
+		__spscring_stat(stats, refreshes);
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+	}
+	if (q->tail_cache - head < count)
+		count = q->tail_cache - head;
+
+	for (i = 0; i != count; i++)
+		eidx[i] = q->array[__lfring_raw_map(head + i, order, n)];
+	if (count != 0)
+		atomic_store_explicit(&q->head, head + count, memory_order_release);
+	return count;
+}
+
+#endif	/* !__SPSCRING_H */
+
+/* vi: set tabstop=4: */
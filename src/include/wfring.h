@@ -0,0 +1,644 @@
+/*
+ * A wait-free ring of indices in the style of wCQ (SPAA '22), built on the
+ * SCQ algorithm of lfring.h.
+ *
+ * Every operation first tries the SCQ fast path up to WFRING_PATIENCE
+ * times. A thread that runs out of patience announces its request in its
+ * record and completes it on the slow path. Every thread also looks at one
+ * other record each WFRING_DELAY operations and helps whatever request it
+ * finds there, so a slow request is finished after a bounded number of
+ * steps by all threads together. Helpers agree on the ring positions of a
+ * request through a two-phase increment of the global head or tail and on
+ * the outcome at each position through a double-width compare-and-swap of
+ * {entry, note}; an index produced by a helper carries a cleared Enq bit
+ * until its request is finalized.
+ *
+ * Unlike the original, thread records are kept inside the ring and are
+ * referred to by thread id, and a request's local head or tail is tagged
+ * with its sequence number, so a ring holds no pointers and can be shared
+ * between address spaces mapped at different addresses.
+ *
+ * The calls take the same arguments as in lfring.h plus the caller's
+ * thread id in [0, threads). Entries are twice as wide as lfring entries
+ * and ring positions must stay below 2^(LFATOMIC_WIDTH-2).
+ */
+
+#ifndef __WFRING_H
+#define __WFRING_H	1
+
+#include "lfring.h"
+
+#ifndef WFRING_PATIENCE
+# define WFRING_PATIENCE	16
+#endif
+#ifndef WFRING_DELAY
+# define WFRING_DELAY	16
+#endif
+
+#if LFATOMIC_WIDTH == 32
+# define WFRING_MIN	(LF_CACHE_SHIFT - 3)
+#elif LFATOMIC_WIDTH == 64
+# define WFRING_MIN	(LF_CACHE_SHIFT - 4)
+#else
+# error "Unsupported LFATOMIC_WIDTH."
+#endif
+
+#define __WFRING_FIN	((lfatomic_t) 1U << (LFATOMIC_WIDTH - 1))
+#define __WFRING_INC	((lfatomic_t) 1U << (LFATOMIC_WIDTH - 2))
+#define __WFRING_DEQ	(~(lfatomic_t) 0U)
+
+#define __WFRING_TAIL	0
+#define __WFRING_HEAD	1
+
+struct __wfring_rec {
+	/* private to the owner */
+	_Alignas(LF_CACHE_BYTES) size_t next_check;
+	size_t next_tid;
+	/* phase 2 of the owner's last slow increment */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_t) p2_seq1;
+	LFATOMIC(lfatomic_t) p2_local;
+	LFATOMIC(lfatomic_t) p2_rseq;
+	LFATOMIC(lfatomic_t) p2_cnt;
+	LFATOMIC(lfatomic_t) p2_seq2;
+	/* the owner's slow request, pending while seq1 == seq2 */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_t) seq1;
+	LFATOMIC(lfatomic_t) eidx;
+	LFATOMIC(lfatomic_t) init;
+	LFATOMIC(lfatomic_t) seq2;
+	/* {position | FIN | INC, request sequence} for the tail and the head */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_aba_t) local[2];
+};
+
+struct __wfring {
+	/* {counter, tid + 1 of a pending phase 2 or 0} */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_aba_t) head;
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfsatomic_t) threshold;
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_aba_t) tail;
+	_Alignas(LF_CACHE_BYTES) size_t threads;
+	/* {entry, note}, followed by the thread records */
+	_Alignas(LF_CACHE_BYTES) LFATOMIC(lfatomic_aba_t) array[1];
+};
+
+struct wfring;
+
+#define WFRING_ALIGN	(_Alignof(struct __wfring))
+#define WFRING_SIZE(o, t)	\
+	(offsetof(struct __wfring, array) +	\
+	 (sizeof(lfatomic_aba_t) << ((o) + 1)) + (t) * sizeof(struct __wfring_rec))
+
+static inline size_t __wfring_map(lfatomic_t idx, size_t order, size_t n)
+{
+#if WFRING_MIN != 0
+	return (size_t) (((idx & (n - 1)) >> (order + 1 - WFRING_MIN)) |
+			((idx << WFRING_MIN) & (n - 1)));
+#else
+	return (size_t) (idx & (n - 1));
+#endif
+}
+
+/*
+ * An entry is [cycle | Enq (2n) | IsSafe (n) | index], where index n-1 marks
+ * a consumed entry and n-2 an entry emptied by a dequeuer; both have the
+ * bit n/2 set, which a real index never has.
+ */
+static inline lfatomic_t __wfring_cycle(lfatomic_t pos, size_t n)
+{
+	return (pos << 2) | (4 * n - 1);
+}
+
+static inline bool __wfring_empty(lfatomic_t entry, size_t n)
+{
+	return (entry & (n >> 1)) != 0;
+}
+
+static inline LFATOMIC(lfatomic_t) *__wfring_word(LFATOMIC(lfatomic_aba_t) * obj)
+{
+	return &((struct __lfatomic_pair *) obj)->stamp;
+}
+
+static inline struct __wfring_rec *__wfring_recs(struct __wfring * q,
+		size_t order)
+{
+	return (struct __wfring_rec *) (q->array + ((size_t) 2 << order));
+}
+
+static inline lfatomic_t __wfring_load_local(LFATOMIC(lfatomic_aba_t) * obj,
+		lfatomic_t * rseq)
+{
+	struct __lfatomic_pair * pair = (struct __lfatomic_pair *) obj;
+	lfatomic_t seq, value;
+
+	do {
+		seq = (lfatomic_t) atomic_load(&pair->value);
+		value = atomic_load(&pair->stamp);
+	} while (seq != (lfatomic_t) atomic_load(&pair->value));
+
+	*rseq = seq;
+	return value;
+}
+
+static inline bool __wfring_cas_local(LFATOMIC(lfatomic_aba_t) * obj,
+		lfatomic_t rseq, lfatomic_t value, lfatomic_t value_new)
+{
+	lfatomic_aba_t expected = { .stamp = value, .value = (void *) rseq };
+	lfatomic_aba_t desired = { .stamp = value_new, .value = (void *) rseq };
+
+	return __lfaba_cmpxchg_strong(obj, &expected, desired,
+			memory_order_seq_cst, memory_order_seq_cst);
+}
+
+static inline void __wfring_set_local(LFATOMIC(lfatomic_aba_t) * obj,
+		lfatomic_t rseq, lfatomic_t value)
+{
+	lfatomic_aba_t expected = __lfaba_load(obj, memory_order_acquire);
+	lfatomic_aba_t desired = { .stamp = value, .value = (void *) rseq };
+
+	while (!__lfaba_cmpxchg_strong(obj, &expected, desired,
+			memory_order_seq_cst, memory_order_seq_cst));
+}
+
+static inline void __wfring_rec_init(struct __wfring_rec * rec, size_t tid,
+		size_t threads)
+{
+	lfatomic_aba_t local = { .stamp = 0, .value = NULL };
+
+	rec->next_check = WFRING_DELAY;
+	rec->next_tid = (tid + 1 == threads) ? 0 : tid + 1;
+	atomic_init(&rec->p2_seq1, 0);
+	atomic_init(&rec->p2_local, 0);
+	atomic_init(&rec->p2_rseq, 0);
+	atomic_init(&rec->p2_cnt, 0);
+	atomic_init(&rec->p2_seq2, 0);
+	atomic_init(&rec->seq1, 1);
+	atomic_init(&rec->eidx, 0);
+	atomic_init(&rec->init, 0);
+	atomic_init(&rec->seq2, 0);
+	__lfaba_init(&rec->local[__WFRING_TAIL], local);
+	__lfaba_init(&rec->local[__WFRING_HEAD], local);
+}
+
+static inline void wfring_init_fill(struct wfring * ring,
+		size_t s, size_t e, size_t order, size_t threads)
+{
+	struct __wfring * q = (struct __wfring *) ring;
+	struct __wfring_rec * recs = __wfring_recs(q, order);
+	size_t i, half = lfring_pow2(order), n = half * 2;
+	lfatomic_aba_t entry = { .stamp = 0, .value = NULL };
+
+	for (i = 0; i != n; i++) {
+		if (i < s)
+			entry.stamp = __wfring_cycle(0, n);
+		else if (i < e)
+			entry.stamp = __wfring_cycle(0, n) ^ (n - 1) ^ i;
+		else
+			entry.stamp = (lfatomic_t) -1;
+		__lfaba_init(&q->array[__wfring_map(i, order, n)], entry);
+	}
+
+	entry.stamp = s;
+	__lfaba_init(&q->head, entry);
+	atomic_init(&q->threshold, e != s ? __lfring_threshold3(half, n) : -1);
+	entry.stamp = e;
+	__lfaba_init(&q->tail, entry);
+
+	q->threads = threads;
+	for (i = 0; i != threads; i++)
+		__wfring_rec_init(&recs[i], i, threads);
+}
+
+static inline void wfring_init_empty(struct wfring * ring, size_t order,
+		size_t threads)
+{
+	wfring_init_fill(ring, 0, 0, order, threads);
+}
+
+/* Finalize the slow enqueue that produced the entry at position tail. */
+static inline void __wfring_finalize_request(struct __wfring * q,
+		struct __wfring_rec * recs, lfatomic_t tail)
+{
+	lfatomic_t rseq;
+	size_t i;
+
+	for (i = 0; i != q->threads; i++) {
+		if (__wfring_load_local(&recs[i].local[__WFRING_TAIL], &rseq) == tail) {
+			__wfring_cas_local(&recs[i].local[__WFRING_TAIL], rseq, tail,
+				tail | __WFRING_FIN);
+			break;
+		}
+	}
+}
+
+static inline void __wfring_finalize_slot(struct __wfring * q, size_t tidx,
+		size_t n, struct __wfring_rec * rec, lfatomic_t rseq,
+		lfatomic_t tail, lfatomic_t entry)
+{
+	if (__wfring_cas_local(&rec->local[__WFRING_TAIL], rseq, tail,
+			tail | __WFRING_FIN)) {
+		entry &= ~(lfatomic_t) (2 * n);
+		atomic_compare_exchange_strong(__wfring_word(&q->array[tidx]),
+			&entry, entry | (2 * n));
+	}
+}
+
+static inline void __wfring_catchup(struct __wfring * q,
+	lfatomic_t tail, lfatomic_t head)
+{
+	while (!atomic_compare_exchange_weak_explicit(__wfring_word(&q->tail),
+			&tail, head, memory_order_acq_rel, memory_order_acquire)) {
+		head = atomic_load_explicit(__wfring_word(&q->head),
+				memory_order_acquire);
+		tail = atomic_load_explicit(__wfring_word(&q->tail),
+				memory_order_acquire);
+		if (__lfring_cmp(tail, >=, head))
+			break;
+	}
+}
+
+static inline bool __wfring_enqueue_slot(struct __wfring * q, size_t order,
+		size_t n, lfatomic_t tail, size_t eidx)
+{
+	LFATOMIC(lfatomic_t) * word;
+	lfatomic_t entry, ecycle, tcycle = __wfring_cycle(tail, n);
+
+	word = __wfring_word(&q->array[__wfring_map(tail, order, n)]);
+	entry = atomic_load_explicit(word, memory_order_acquire);
+	do {
+		ecycle = entry | (4 * n - 1);
+		if (!(__lfring_cmp(ecycle, <, tcycle) && __wfring_empty(entry, n) &&
+				((entry & n) || __lfring_cmp(atomic_load_explicit(
+				__wfring_word(&q->head), memory_order_acquire), <=, tail))))
+			return false;
+	} while (!atomic_compare_exchange_weak_explicit(word, &entry,
+			tcycle ^ eidx, memory_order_acq_rel, memory_order_acquire));
+
+	return true;
+}
+
+static inline bool __wfring_dequeue_slot(struct __wfring * q, size_t order,
+		size_t n, lfatomic_t head, size_t * eidx)
+{
+	LFATOMIC(lfatomic_t) * word;
+	lfatomic_t entry, entry_new, ecycle, hcycle = __wfring_cycle(head, n);
+
+	word = __wfring_word(&q->array[__wfring_map(head, order, n)]);
+	entry = atomic_load_explicit(word, memory_order_acquire);
+	do {
+		ecycle = entry | (4 * n - 1);
+		if (ecycle == hcycle) {
+			if (!(entry & (2 * n)))
+				__wfring_finalize_request(q, __wfring_recs(q, order), head);
+			atomic_fetch_or_explicit(word, 3 * n - 1, memory_order_acq_rel);
+			*eidx = (size_t) (entry & (n - 1));
+			return true;
+		}
+
+		if (!__wfring_empty(entry, n)) {
+			entry_new = entry & ~(lfatomic_t) n;
+			if (entry == entry_new)
+				break;
+		} else {
+			entry_new = hcycle ^ 1 ^ ((~entry) & n);
+		}
+	} while (__lfring_cmp(ecycle, <, hcycle) &&
+				!atomic_compare_exchange_weak_explicit(word, &entry, entry_new,
+				memory_order_acq_rel, memory_order_acquire));
+
+	return false;
+}
+
+/*
+ * Read the global head or tail counter, first helping to complete the
+ * phase 2 of a pending slow increment. Fails once the request that local
+ * belongs to is finalized or gone.
+ */
+static inline bool __wfring_load_global(struct __wfring_rec * recs,
+		LFATOMIC(lfatomic_aba_t) * global, LFATOMIC(lfatomic_aba_t) * local,
+		lfatomic_t rseq, lfatomic_t * cnt)
+{
+	struct __wfring_rec * rec;
+	lfatomic_aba_t value, clear;
+	lfatomic_t seq, s, p2_local, p2_rseq, p2_cnt;
+
+	do {
+		if ((__wfring_load_local(local, &s) & __WFRING_FIN) || s != rseq)
+			return false;
+		value = __lfaba_load(global, memory_order_acquire);
+		if (value.value == NULL)
+			break;
+		rec = &recs[(lfatomic_t) value.value - 1];
+		seq = atomic_load(&rec->p2_seq2);
+		p2_local = atomic_load(&rec->p2_local);
+		p2_rseq = atomic_load(&rec->p2_rseq);
+		p2_cnt = atomic_load(&rec->p2_cnt);
+		/* a phase 2 prepared after value was read has p2_cnt >= stamp */
+		if (atomic_load(&rec->p2_seq1) == seq &&
+				__lfring_cmp(p2_cnt, <, value.stamp))
+			__wfring_cas_local(&recs[p2_local >> 1].local[p2_local & 1],
+				p2_rseq, p2_cnt | __WFRING_INC, p2_cnt);
+		clear.stamp = value.stamp;
+		clear.value = NULL;
+	} while (!__lfaba_cmpxchg_strong(global, &value, clear,
+			memory_order_seq_cst, memory_order_seq_cst));
+
+	*cnt = value.stamp;
+	return true;
+}
+
+/*
+ * Advance the local head or tail of request rseq of thread tid from *pos to
+ * the next position, which is reserved for it in the global counter exactly
+ * once however many threads help. Returns false once the request is
+ * finalized.
+ */
+static inline bool __wfring_slow_inc(struct __wfring * q,
+		struct __wfring_rec * recs, size_t which, size_t tid, lfatomic_t rseq,
+		lfatomic_t * pos, size_t self)
+{
+	LFATOMIC(lfatomic_aba_t) * global = (which == __WFRING_HEAD) ?
+			&q->head : &q->tail;
+	LFATOMIC(lfatomic_aba_t) * local = &recs[tid].local[which];
+	struct __wfring_rec * rec = &recs[self];
+	lfatomic_aba_t expected, desired;
+	lfatomic_t cnt, seq, s;
+
+	do {
+		if (!__wfring_load_global(recs, global, local, rseq, &cnt))
+			return false;
+		if (!__wfring_cas_local(local, rseq, *pos, cnt | __WFRING_INC)) {
+			*pos = __wfring_load_local(local, &s);
+			if ((*pos & __WFRING_FIN) || s != rseq)
+				return false;
+			if (!(*pos & __WFRING_INC))
+				return true;
+			cnt = *pos & ~__WFRING_INC;
+		} else {
+			*pos = cnt | __WFRING_INC;
+		}
+
+		seq = atomic_load_explicit(&rec->p2_seq1, memory_order_relaxed) + 1;
+		atomic_store(&rec->p2_seq1, seq);
+		atomic_store(&rec->p2_local, (tid << 1) | which);
+		atomic_store(&rec->p2_rseq, rseq);
+		atomic_store(&rec->p2_cnt, cnt);
+		atomic_store(&rec->p2_seq2, seq);
+
+		expected.stamp = cnt;
+		expected.value = NULL;
+		desired.stamp = cnt + 1;
+		desired.value = (void *) (self + 1);
+	} while (!__lfaba_cmpxchg_strong(global, &expected, desired,
+			memory_order_seq_cst, memory_order_seq_cst));
+
+	if (which == __WFRING_HEAD)
+		atomic_fetch_sub(&q->threshold, 1);
+	__wfring_cas_local(local, rseq, cnt | __WFRING_INC, cnt);
+	expected = desired;
+	desired.value = NULL;
+	__lfaba_cmpxchg_strong(global, &expected, desired,
+			memory_order_seq_cst, memory_order_seq_cst);
+
+	*pos = cnt;
+	return true;
+}
+
+static inline bool __wfring_enqueue_slow_slot(struct __wfring * q,
+		size_t order, size_t n, lfatomic_t tail, size_t eidx,
+		struct __wfring_rec * rec, lfatomic_t rseq)
+{
+	size_t tidx = __wfring_map(tail, order, n);
+	lfatomic_t entry, note, ecycle, tcycle = __wfring_cycle(tail, n);
+	lfatomic_aba_t pair, desired;
+
+	pair = __lfaba_load(&q->array[tidx], memory_order_acquire);
+	while (1) {
+		entry = pair.stamp;
+		note = (lfatomic_t) pair.value;
+		ecycle = entry | (4 * n - 1);
+		/* produced by another helper */
+		if (ecycle == tcycle && !__wfring_empty(entry, n)) {
+			__wfring_finalize_slot(q, tidx, n, rec, rseq, tail, entry);
+			return true;
+		}
+		if (!__lfring_cmp(ecycle, <, tcycle) || !__lfring_cmp(note, <, tcycle))
+			return false;
+
+		if (!__wfring_empty(entry, n) || (!(entry & n) &&
+				__lfring_cmp(atomic_load(__wfring_word(&q->head)), >, tail))) {
+			/* unusable: make sure no other helper produces here */
+			desired.stamp = entry;
+			desired.value = (void *) tcycle;
+			if (__lfaba_cmpxchg_strong(&q->array[tidx], &pair, desired,
+					memory_order_seq_cst, memory_order_seq_cst))
+				return false;
+			continue;
+		}
+
+		desired.stamp = tcycle ^ eidx ^ (2 * n);
+		desired.value = pair.value;
+		if (__lfaba_cmpxchg_strong(&q->array[tidx], &pair, desired,
+				memory_order_seq_cst, memory_order_seq_cst)) {
+			__wfring_finalize_slot(q, tidx, n, rec, rseq, tail, desired.stamp);
+			return true;
+		}
+	}
+}
+
+static inline void __wfring_dequeue_slow_slot(struct __wfring * q,
+		size_t order, size_t n, lfatomic_t head, struct __wfring_rec * rec,
+		lfatomic_t rseq)
+{
+	size_t hidx = __wfring_map(head, order, n);
+	lfatomic_t entry, ecycle, hcycle = __wfring_cycle(head, n), tail;
+	lfatomic_aba_t pair, desired;
+
+	pair = __lfaba_load(&q->array[hidx], memory_order_acquire);
+	while (1) {
+		entry = pair.stamp;
+		ecycle = entry | (4 * n - 1);
+		/* an index for this request, possibly consumed by its owner */
+		if (ecycle == hcycle && (entry & (n - 1)) != n - 2) {
+			__wfring_cas_local(&rec->local[__WFRING_HEAD], rseq, head,
+				head | __WFRING_FIN);
+			return;
+		}
+		if (!__lfring_cmp(ecycle, <, hcycle))
+			break;
+
+		if (!__wfring_empty(entry, n)) {
+			desired.stamp = entry & ~(lfatomic_t) n;
+			if (entry == desired.stamp)
+				break;
+		} else {
+			desired.stamp = hcycle ^ 1 ^ ((~entry) & n);
+		}
+		desired.value = pair.value;
+		if (__lfaba_cmpxchg_strong(&q->array[hidx], &pair, desired,
+				memory_order_seq_cst, memory_order_seq_cst))
+			break;
+	}
+
+	/* nothing at this position: stop if the ring is empty */
+	tail = atomic_load(__wfring_word(&q->tail));
+	if (__lfring_cmp(tail, <=, head + 1)) {
+		__wfring_catchup(q, tail, head + 1);
+	} else if (atomic_load(&q->threshold) >= 0) {
+		return;
+	}
+	__wfring_cas_local(&rec->local[__WFRING_HEAD], rseq, head,
+		head | __WFRING_FIN);
+}
+
+static inline void __wfring_do_enqueue(struct __wfring * q, size_t order,
+		size_t n, size_t tid, lfatomic_t rseq, lfatomic_t tail, size_t eidx,
+		size_t self)
+{
+	struct __wfring_rec * recs = __wfring_recs(q, order);
+
+	while (__wfring_slow_inc(q, recs, __WFRING_TAIL, tid, rseq, &tail, self)) {
+		if (__wfring_enqueue_slow_slot(q, order, n, tail, eidx, &recs[tid],
+				rseq)) {
+			if (atomic_load(&q->threshold) != __lfring_threshold3(n / 2, n))
+				atomic_store(&q->threshold, __lfring_threshold3(n / 2, n));
+			break;
+		}
+	}
+}
+
+static inline void __wfring_do_dequeue(struct __wfring * q, size_t order,
+		size_t n, size_t tid, lfatomic_t rseq, lfatomic_t head, size_t self)
+{
+	struct __wfring_rec * recs = __wfring_recs(q, order);
+
+	while (__wfring_slow_inc(q, recs, __WFRING_HEAD, tid, rseq, &head, self))
+		__wfring_dequeue_slow_slot(q, order, n, head, &recs[tid], rseq);
+}
+
+static inline void __wfring_help(struct __wfring * q, size_t order, size_t n,
+		size_t self)
+{
+	struct __wfring_rec * rec = &__wfring_recs(q, order)[self], * other;
+	lfatomic_t seq, eidx, init;
+	size_t tid;
+
+	if (--rec->next_check != 0)
+		return;
+
+	tid = rec->next_tid;
+	other = &__wfring_recs(q, order)[tid];
+	seq = atomic_load(&other->seq2);
+	eidx = atomic_load(&other->eidx);
+	init = atomic_load(&other->init);
+	if (atomic_load(&other->seq1) == seq) {
+		if (eidx == __WFRING_DEQ)
+			__wfring_do_dequeue(q, order, n, tid, seq, init, self);
+		else
+			__wfring_do_enqueue(q, order, n, tid, seq, init, eidx, self);
+	}
+
+	rec->next_check = WFRING_DELAY;
+	rec->next_tid = (tid + 1 == q->threads) ? 0 : tid + 1;
+}
+
+static inline void wfring_enqueue(struct wfring * ring, size_t order,
+		size_t eidx, bool nonempty, size_t tid)
+{
+	struct __wfring * q = (struct __wfring *) ring;
+	struct __wfring_rec * rec = &__wfring_recs(q, order)[tid];
+	size_t half = lfring_pow2(order), n = half * 2;
+	size_t patience = WFRING_PATIENCE;
+	lfatomic_t tail, seq, rseq;
+
+	eidx ^= (n - 1);
+	__wfring_help(q, order, n, tid);
+
+	do {
+		tail = atomic_fetch_add_explicit(__wfring_word(&q->tail), 1,
+				memory_order_acq_rel);
+		if (__wfring_enqueue_slot(q, order, n, tail, eidx))
+			goto done;
+	} while (--patience != 0);
+
+	/* announce the request and complete it with whoever helps */
+	seq = atomic_load_explicit(&rec->seq1, memory_order_relaxed);
+	__wfring_set_local(&rec->local[__WFRING_TAIL], seq, tail);
+	atomic_store(&rec->init, tail);
+	atomic_store(&rec->eidx, eidx);
+	atomic_store(&rec->seq2, seq);
+	__wfring_do_enqueue(q, order, n, tid, seq, tail, eidx, tid);
+
+	/* it is produced at the local tail, make sure it is also finalized */
+	tail = __wfring_load_local(&rec->local[__WFRING_TAIL], &rseq);
+	if (!(tail & __WFRING_FIN))
+		__wfring_finalize_slot(q, __wfring_map(tail, order, n), n, rec, seq,
+			tail, __wfring_cycle(tail, n) ^ eidx);
+	atomic_store(&rec->seq1, seq + 1);
+
+done:
+	if (!nonempty && (atomic_load(&q->threshold) != __lfring_threshold3(half, n)))
+		atomic_store(&q->threshold, __lfring_threshold3(half, n));
+}
+
+static inline size_t wfring_dequeue(struct wfring * ring, size_t order,
+		bool nonempty, size_t tid)
+{
+	struct __wfring * q = (struct __wfring *) ring;
+	struct __wfring_rec * rec = &__wfring_recs(q, order)[tid];
+	size_t eidx, n = lfring_pow2(order + 1);
+	size_t patience = WFRING_PATIENCE;
+	lfatomic_t head, tail, entry, seq, rseq;
+	LFATOMIC(lfatomic_t) * word;
+
+	if (!nonempty && atomic_load_explicit(&q->threshold, memory_order_acquire) < 0) {
+		return LFRING_EMPTY;
+	}
+
+	__wfring_help(q, order, n, tid);
+
+	do {
+		head = atomic_fetch_add_explicit(__wfring_word(&q->head), 1,
+				memory_order_acq_rel);
+		if (__wfring_dequeue_slot(q, order, n, head, &eidx))
+			return eidx;
+
+		if (!nonempty) {
+			tail = atomic_load_explicit(__wfring_word(&q->tail),
+					memory_order_acquire);
+			if (__lfring_cmp(tail, <=, head + 1)) {
+				__wfring_catchup(q, tail, head + 1);
+				atomic_fetch_sub_explicit(&q->threshold, 1,
+					memory_order_acq_rel);
+				return LFRING_EMPTY;
+			}
+
+			if (atomic_fetch_sub_explicit(&q->threshold, 1,
+					memory_order_acq_rel) <= 0)
+				return LFRING_EMPTY;
+		}
+	} while (--patience != 0);
+
+	/* announce the request and complete it with whoever helps */
+	seq = atomic_load_explicit(&rec->seq1, memory_order_relaxed);
+	__wfring_set_local(&rec->local[__WFRING_HEAD], seq, head);
+	atomic_store(&rec->init, head);
+	atomic_store(&rec->eidx, __WFRING_DEQ);
+	atomic_store(&rec->seq2, seq);
+	__wfring_do_dequeue(q, order, n, tid, seq, head, tid);
+	head = __wfring_load_local(&rec->local[__WFRING_HEAD], &rseq) &
+			~__WFRING_FIN;
+	atomic_store(&rec->seq1, seq + 1);
+
+	/* the request ended at the position of its index, if it got one */
+	word = __wfring_word(&q->array[__wfring_map(head, order, n)]);
+	entry = atomic_load(word);
+	if ((entry | (4 * n - 1)) != __wfring_cycle(head, n) ||
+			__wfring_empty(entry, n))
+		return LFRING_EMPTY;
+	if (!(entry & (2 * n)))
+		__wfring_finalize_request(q, __wfring_recs(q, order), head);
+	atomic_fetch_or(word, 3 * n - 1);
+	return (size_t) (entry & (n - 1));
+}
+
+#endif	/* !__WFRING_H */
+
+/* vi: set tabstop=4: */
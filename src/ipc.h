@@ -0,0 +1,146 @@
+#ifndef __IPC_H__
+#define __IPC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <sel4/sel4.h>
+
+#include "counter.h"
+#include "poll.h"
+#include "histogram.h"
+#include "loadgen.h"
+
+/*
+ * Native IPC baseline for the rings.
+ *
+ * app answers seL4_Call()s on an endpoint with seL4_ReplyRecv(), sending
+ * every message register back as it came, which is the echo app.c does
+ * through the rings done by the kernel instead. main calls with payloads
+ * of ipc_words[] words and prints a CSV row per payload with the same
+ * columns as the ring sweep, then offers the ring's payload at each of
+ * load_percent[] of the IPC capacity and prints rows like load_sweep()'s.
+ * seL4_Call() blocks, so an open-loop request that comes due during the
+ * previous call waits for it, and the wait is counted as with the rings.
+ *
+ * A call with label IPC_DONE is answered and then ends the echo loop.
+ */
+
+#define IPC_ECHO 0
+#define IPC_DONE 1
+
+#ifndef IPC_ITER
+#define IPC_ITER 100000
+#endif
+
+static const size_t ipc_words[] = {1, 2, 4, 8, 16, 32};
+
+/* app: echo calls on ep until IPC_DONE */
+static inline void ipc_serve(seL4_CPtr ep) {
+    seL4_MessageInfo_t info = seL4_Recv(ep, NULL);
+
+    while (seL4_MessageInfo_get_label(info) == IPC_ECHO) {
+        info = seL4_ReplyRecv(ep, info, NULL);
+    }
+    seL4_Reply(seL4_MessageInfo_new(IPC_DONE, 0, 0, 0));
+}
+
+/* main: one echo of words message registers */
+static inline void ipc_call(seL4_CPtr ep, size_t words, unsigned long i) {
+    seL4_MessageInfo_t info;
+
+    for (size_t w = 0; w < words; w++) {
+        seL4_SetMR(w, i + w);
+    }
+    info = seL4_Call(ep, seL4_MessageInfo_new(IPC_ECHO, 0, 0, words));
+
+    /* sanity check */
+    assert(seL4_MessageInfo_get_length(info) == words);
+    assert(seL4_GetMR(words - 1) == i + words - 1);
+}
+
+static inline void ipc_done(seL4_CPtr ep) {
+    seL4_Call(ep, seL4_MessageInfo_new(IPC_DONE, 0, 0, 0));
+}
+
+/* closed-loop ticks per call, every call recorded in rtt */
+static inline uint64_t ipc_run(seL4_CPtr ep, size_t words, struct histogram *rtt) {
+    uint64_t start, t0, t1;
+
+    hist_init(rtt);
+    start = poll_now();
+    for (unsigned long i = 0; i < IPC_ITER; i++) {
+        READ_COUNTER_BEFORE(t0);
+        ipc_call(ep, words, i);
+        READ_COUNTER_AFTER(t1);
+        hist_record(rtt, counter_elapsed(t0, t1));
+    }
+    return (poll_now() - start) / IPC_ITER;
+}
+
+/* words per call on g's schedule, returns the ticks until the last returned */
+static inline uint64_t ipc_load_run(struct loadgen *g, seL4_CPtr ep, size_t words,
+                                    struct histogram *rtt) {
+    uint64_t start = poll_now(), at;
+    double next = start;
+
+    hist_init(rtt);
+    for (unsigned long i = 0; i < IPC_ITER; i++) {
+        at = (uint64_t)next;
+        while ((int64_t)(poll_now() - at) < 0) {
+            poll_pause();
+        }
+        ipc_call(ep, words, i);
+        hist_record(rtt, counter_elapsed(at, poll_now()));
+        next += load_gap(g);
+    }
+    return poll_now() - start;
+}
+
+static inline void ipc_sweep(seL4_CPtr ep, const char *placement, struct histogram *rtt) {
+    uint64_t ticks, capacity = 0, hz = counter_calibration()->hz;
+    size_t words = MSG_WORDS;
+    struct loadgen g;
+    double gap, achieved;
+    char name[40];
+
+    printf("ipc,placement,words,requests,cycles_per_msg,ns_per_msg,msgs_per_sec,"
+           "p50,p90,p99,p999,max\n");
+    for (size_t i = 0; i < sizeof(ipc_words) / sizeof(ipc_words[0]); i++) {
+        ticks = ipc_run(ep, ipc_words[i], rtt);
+        if (ipc_words[i] == words) {
+            capacity = ticks;
+        }
+
+        printf("ipc,%s,%zu,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", placement, ipc_words[i],
+            IPC_ITER, (unsigned long)ticks, (unsigned long)counter_ns(ticks),
+            ticks != 0 ? (unsigned long)(hz / ticks) : 0,
+            (unsigned long)hist_percentile(rtt, 500000), (unsigned long)hist_percentile(rtt, 900000),
+            (unsigned long)hist_percentile(rtt, 990000), (unsigned long)hist_percentile(rtt, 999000),
+            (unsigned long)rtt->max);
+        snprintf(name, sizeof(name), "ipc_%s_%zu", placement, ipc_words[i]);
+        hist_print(rtt, name);
+    }
+    if (capacity == 0) {
+        capacity = ipc_run(ep, words, rtt);
+    }
+
+    printf("ipc_load,placement,words,percent,gap_ticks,ticks_per_msg,offered_msgs_per_sec,"
+           "achieved_msgs_per_sec,p50,p90,p99,p999,max\n");
+    for (size_t i = 0; i < sizeof(load_percent) / sizeof(load_percent[0]); i++) {
+        gap = (double)capacity * 100 / load_percent[i];
+        load_init(&g, LOAD_CONSTANT, gap);
+        achieved = (double)ipc_load_run(&g, ep, words, rtt) / IPC_ITER;
+
+        printf("ipc_load,%s,%zu,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", placement, words,
+            load_percent[i], (unsigned long)gap, (unsigned long)achieved, load_rate(gap),
+            load_rate(achieved), (unsigned long)hist_percentile(rtt, 500000),
+            (unsigned long)hist_percentile(rtt, 900000), (unsigned long)hist_percentile(rtt, 990000),
+            (unsigned long)hist_percentile(rtt, 999000), (unsigned long)rtt->max);
+        snprintf(name, sizeof(name), "ipc_load_%s_%u", placement, load_percent[i]);
+        hist_print(rtt, name);
+    }
+}
+
+#endif
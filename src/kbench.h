@@ -0,0 +1,142 @@
+#ifndef __KBENCH_H__
+#define __KBENCH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <sel4/sel4.h>
+#include <vka/vka.h>
+#include <vka/object.h>
+
+/*
+ * Kernel cost of the message path, from the kernel's benchmark support.
+ *
+ * With CONFIG_BENCHMARK_TRACK_UTILISATION the kernel counts the cycles each
+ * thread runs, kernel time on its behalf included, and the cycles the core
+ * sits idle. With CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES it logs every kernel
+ * entry into a buffer of ours, and the number of entries in it is the count
+ * of syscalls, faults and interrupts taken. Both run between kbench_start()
+ * and kbench_stop(), and kbench_print() turns them into a CSV row of costs
+ * per message, so a run at a given load shows what each message takes out
+ * of the core and not only how long it waits.
+ *
+ * Utilisation is per core: main, the receiver thread and app only show
+ * time apart from each other's idle time when they share the core.
+ * KBENCH is defined when either option is set.
+ *
+ * An open-loop sender spins until each send is due, and that spinning is
+ * CPU time of its thread too. kbench_print() takes the ticks the sender
+ * spent so (loadgen.h) and reports them in a pacing column of their own;
+ * the sender's cycles_per_msg still include them.
+ */
+
+#if defined(CONFIG_BENCHMARK_TRACK_UTILISATION) || defined(CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES)
+#define KBENCH 1
+
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+#include <sel4/benchmark_utilisation_types.h>
+#endif
+#ifdef CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES
+#include <sel4/benchmark_track_types.h>
+#endif
+
+#define KBENCH_MAX_THREADS 4
+
+struct kbench {
+    size_t threads;
+    const char *name[KBENCH_MAX_THREADS];
+    seL4_CPtr tcb[KBENCH_MAX_THREADS];
+    uint64_t cycles[KBENCH_MAX_THREADS]; /* run by each thread */
+    uint64_t total;                      /* cycles from start to stop */
+    uint64_t idle;                       /* cycles the core was idle */
+    unsigned long entries;               /* kernel entries logged */
+    unsigned long log_size;              /* entries the log holds */
+};
+
+static inline void kbench_init(struct kbench *k, vka_t *vka) {
+    k->threads = 0;
+    k->log_size = 0;
+#ifdef CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES
+    vka_object_t log;
+    UNUSED int error;
+
+    /* the kernel wants one large page for the log */
+    error = vka_alloc_frame(vka, seL4_LargePageBits, &log);
+    assert(error == 0);
+    error = seL4_BenchmarkSetLogBuffer(log.cptr);
+    assert(error == seL4_NoError);
+    k->log_size = BIT(seL4_LargePageBits) / sizeof(benchmark_track_kernel_entry_t);
+#endif
+}
+
+static inline void kbench_add_thread(struct kbench *k, const char *name, seL4_CPtr tcb) {
+    assert(k->threads < KBENCH_MAX_THREADS);
+    k->name[k->threads] = name;
+    k->tcb[k->threads] = tcb;
+    k->threads++;
+}
+
+static inline void kbench_start(struct kbench *k) {
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+    for (size_t i = 0; i < k->threads; i++) {
+        seL4_BenchmarkResetThreadUtilisation(k->tcb[i]);
+    }
+#endif
+    seL4_BenchmarkResetLog();
+}
+
+static inline void kbench_stop(struct kbench *k) {
+    k->entries = seL4_BenchmarkFinalizeLog();
+    k->total = k->idle = 0;
+#ifdef CONFIG_BENCHMARK_TRACK_UTILISATION
+    uint64_t *buf = (uint64_t *) &seL4_GetIPCBuffer()->msg[0];
+
+    for (size_t i = 0; i < k->threads; i++) {
+        seL4_BenchmarkGetThreadUtilisation(k->tcb[i]);
+        k->cycles[i] = buf[BENCHMARK_TCB_UTILISATION];
+        k->total = buf[BENCHMARK_TOTAL_UTILISATION];
+        k->idle = buf[BENCHMARK_IDLE_LOCALCPU_UTILISATION];
+    }
+#else
+    for (size_t i = 0; i < k->threads; i++) {
+        k->cycles[i] = 0;
+    }
+#endif
+#ifndef CONFIG_BENCHMARK_TRACK_KERNEL_ENTRIES
+    k->entries = 0;
+#endif
+}
+
+/* x in thousandths of y */
+static inline unsigned long kbench_permille(uint64_t x, uint64_t y) {
+    return y != 0 ? (unsigned long)(x * 1000 / y) : 0;
+}
+
+static inline void kbench_print_header(const struct kbench *k) {
+    printf("kernel,label,requests,entries_per_msg,log_full,cycles_per_msg,idle_permille,"
+           "pacing_ticks_per_msg");
+    for (size_t i = 0; i < k->threads; i++) {
+        printf(",%s_cycles_per_msg,%s_permille", k->name[i], k->name[i]);
+    }
+    printf("\n");
+}
+
+/* paced is the ticks the sender spun waiting for send times, or 0 */
+static inline void kbench_print(const struct kbench *k, const char *label, unsigned long msgs,
+                                uint64_t paced) {
+    printf("kernel,%s,%lu,%lu.%02lu,%d,%lu,%lu,%lu", label, msgs,
+        msgs != 0 ? k->entries / msgs : 0, msgs != 0 ? k->entries * 100 / msgs % 100 : 0,
+        k->log_size != 0 && k->entries >= k->log_size,
+        msgs != 0 ? (unsigned long)(k->total / msgs) : 0, kbench_permille(k->idle, k->total),
+        msgs != 0 ? (unsigned long)(paced / msgs) : 0);
+    for (size_t i = 0; i < k->threads; i++) {
+        printf(",%lu,%lu", msgs != 0 ? (unsigned long)(k->cycles[i] / msgs) : 0,
+            kbench_permille(k->cycles[i], k->total));
+    }
+    printf("\n");
+}
+
+#endif
+
+#endif
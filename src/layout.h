@@ -0,0 +1,216 @@
+#ifndef __LAYOUT_H__
+#define __LAYOUT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef RING_HOST
+#include <stdlib.h>
+
+/* the fatal check of the seL4 libraries, as app.c uses it for its arguments */
+#define ZF_LOGF_IF(cond, ...) do {                                                  \
+    if (cond) {                                                                     \
+        fprintf(stderr, __VA_ARGS__);                                               \
+        abort();                                                                    \
+    }                                                                               \
+} while (0)
+#else
+#include <utils/zf_log.h>
+#include <sel4utils/sel4_zf_logif.h>
+#endif
+
+/*
+ * Self-describing header of the shared region.
+ *
+ * The first page of the region holds a struct layout, which main fills in
+ * with layout_init() before app is spawned. It records:
+ *
+ *   - a magic number, the layout version and the page size;
+ *   - the length of the region and the features it was built with;
+ *   - for each channel, its ring types, ring and buffer orders, slot size
+ *     and slot stride, and the first page and length of its rings and data
+ *     buffer;
+ *   - the first page and length of the stats, trace and pmu areas.
+ *
+ * app locates every region through the header with layout_region(), not
+ * through the page arithmetic of ring.h. layout_check() stops app at start,
+ * naming the field that differs, if the header is not one it can use, and
+ * layout_region() if a region does not lie within the shared region. Both
+ * stay in with NDEBUG.
+ *
+ * The channel operations are specialised for their geometry at compile
+ * time (channel.h), so app must still be built with the same per-channel
+ * orders, ring types and strides as main. Each channel is sized on its
+ * own with -DREQ_RING_ORDER, -DREQ_BUFFER_ORDER, -DRSP_RING_ORDER and
+ * -DRSP_BUFFER_ORDER, for example small rings for control traffic and
+ * big ones for bulk.
+ */
+
+#define LAYOUT_MAGIC   0x474e4952 /* "RING" in a little-endian dump */
+#define LAYOUT_VERSION 1
+#define LAYOUT_NONE    UINT32_MAX /* page of a region the build does not have */
+
+/* features that change what is in the region or how both sides use it */
+#define LAYOUT_INLINE  (1U << 0)
+#define LAYOUT_INPLACE (1U << 1)
+#define LAYOUT_STATS   (1U << 2)
+#define LAYOUT_TRACE   (1U << 3)
+#define LAYOUT_PMU     (1U << 4)
+
+struct layout_area {
+    uint32_t page;  /* first page, LAYOUT_NONE if absent */
+    uint32_t pages;
+};
+
+struct layout_channel {
+    uint32_t fring_type;
+    uint32_t aring_type;
+    uint32_t ring_order;
+    uint32_t buffer_order;
+    uint32_t slot_size;
+    uint32_t slot_stride;
+    struct layout_area fring; /* absent with RING_INLINE */
+    struct layout_area aring;
+    struct layout_area data;  /* absent with RING_INLINE */
+};
+
+struct layout {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t pages;      /* of the whole region */
+    uint32_t map_bits;   /* the region is mapped 1 << map_bits bytes at a time */
+    uint32_t features;
+    struct layout_channel req;
+    struct layout_channel rsp;
+    struct layout_area stats; /* absent unless built with them */
+    struct layout_area trace;
+    struct layout_area pmu;
+};
+
+_Static_assert(sizeof(struct layout) <= LAYOUT_PAGES * PAGE_SIZE,
+               "the layout header must fit its pages");
+
+static inline uint32_t layout_features(void) {
+    uint32_t features = 0;
+
+#ifdef RING_INLINE
+    features |= LAYOUT_INLINE;
+#endif
+#ifdef RING_INPLACE
+    features |= LAYOUT_INPLACE;
+#endif
+#ifdef RING_STATS
+    features |= LAYOUT_STATS;
+#endif
+#ifdef RING_TRACE
+    features |= LAYOUT_TRACE;
+#endif
+#ifdef RING_PMU
+    features |= LAYOUT_PMU;
+#endif
+    return features;
+}
+
+/* a region of pages pages at page, absent when it has none */
+static inline struct layout_area layout_place(uint32_t page, size_t pages) {
+    struct layout_area a = { pages != 0 ? page : LAYOUT_NONE, pages };
+
+    return a;
+}
+
+/* main: describe this build's region in l */
+static inline void layout_init(struct layout *l) {
+    l->magic = LAYOUT_MAGIC;
+    l->version = LAYOUT_VERSION;
+    l->page_size = PAGE_SIZE;
+    l->pages = SHARED_PAGES;
+    l->map_bits = MAP_BITS;
+    l->features = layout_features();
+
+    l->req.fring_type = REQ_FRING_TYPE;
+    l->req.aring_type = REQ_ARING_TYPE;
+    l->req.ring_order = REQ_RING_ORDER;
+    l->req.buffer_order = REQ_BUFFER_ORDER;
+    l->req.slot_size = sizeof(struct msg);
+    l->req.slot_stride = REQ_SLOT_STRIDE;
+    l->req.fring = layout_place(REQ_FRING_PAGE, REQ_FRING_PAGES);
+    l->req.aring = layout_place(REQ_ARING_PAGE, REQ_ARING_PAGES);
+    l->req.data = layout_place(REQ_DATA_PAGE, REQ_DATA_PAGES);
+
+    l->rsp.fring_type = RSP_FRING_TYPE;
+    l->rsp.aring_type = RSP_ARING_TYPE;
+    l->rsp.ring_order = RSP_RING_ORDER;
+    l->rsp.buffer_order = RSP_BUFFER_ORDER;
+    l->rsp.slot_size = sizeof(struct msg);
+    l->rsp.slot_stride = RSP_SLOT_STRIDE;
+#ifdef RING_INPLACE
+    /* responses travel in the request slots */
+    l->rsp.fring = l->req.fring;
+    l->rsp.data = l->req.data;
+#else
+    l->rsp.fring = layout_place(RSP_FRING_PAGE, RSP_FRING_PAGES);
+    l->rsp.data = layout_place(RSP_DATA_PAGE, RSP_DATA_PAGES);
+#endif
+    l->rsp.aring = layout_place(RSP_ARING_PAGE, RSP_ARING_PAGES);
+
+    l->stats = layout_place(STATS_PAGE, STATS_PAGES);
+    l->trace = layout_place(TRACE_PAGE, TRACE_PAGES);
+    l->pmu = layout_place(PMU_PAGE, PMU_PAGES);
+}
+
+/* stop if field of header l is not what this build, own, has */
+#define LAYOUT_CHECK(l, own, name, field)                                           \
+        ZF_LOGF_IF((l)->field != (own)->field, "Layout %s%s is %lu, not %lu.\n",    \
+                   (name), #field, (unsigned long)(l)->field, (unsigned long)(own)->field)
+
+/* does channel c have the geometry this build's operations are specialised for */
+static inline void layout_check_channel(const char *name, const struct layout_channel *c,
+                                        const struct layout_channel *own) {
+    LAYOUT_CHECK(c, own, name, fring_type);
+    LAYOUT_CHECK(c, own, name, aring_type);
+    LAYOUT_CHECK(c, own, name, ring_order);
+    LAYOUT_CHECK(c, own, name, buffer_order);
+    LAYOUT_CHECK(c, own, name, slot_size);
+    LAYOUT_CHECK(c, own, name, slot_stride);
+    LAYOUT_CHECK(c, own, name, fring.pages);
+    LAYOUT_CHECK(c, own, name, aring.pages);
+    LAYOUT_CHECK(c, own, name, data.pages);
+}
+
+/* app: check that main's header l describes a region this build can use */
+static inline void layout_check(const struct layout *l) {
+    struct layout own;
+
+    layout_init(&own);
+    LAYOUT_CHECK(l, &own, "", magic);
+    LAYOUT_CHECK(l, &own, "", version);
+    LAYOUT_CHECK(l, &own, "", page_size);
+    LAYOUT_CHECK(l, &own, "", features);
+    layout_check_channel("req.", &l->req, &own.req);
+    layout_check_channel("rsp.", &l->rsp, &own.rsp);
+    LAYOUT_CHECK(l, &own, "", stats.pages);
+    LAYOUT_CHECK(l, &own, "", trace.pages);
+    LAYOUT_CHECK(l, &own, "", pmu.pages);
+}
+
+/* address of region a of header l, NULL if absent */
+static inline void *layout_region(void *shared_mem, const struct layout *l,
+                                  const struct layout_area *a) {
+    if (a->page == LAYOUT_NONE) {
+        return NULL;
+    }
+    ZF_LOGF_IF(a->page > l->pages || a->pages > l->pages - a->page,
+               "Layout region of %u pages at page %u runs past the %u shared pages.\n",
+               a->pages, a->page, l->pages);
+    return (char *) shared_mem + (size_t) a->page * l->page_size;
+}
+
+static inline void layout_print(const char *who, const struct layout *l) {
+    printf("%s: layout v%u, %u pages mapped %u bits at a time, "
+           "req ring %u buffer %u stride %u, rsp ring %u buffer %u stride %u\n",
+        who, l->version, l->pages, l->map_bits, l->req.ring_order, l->req.buffer_order,
+        l->req.slot_stride, l->rsp.ring_order, l->rsp.buffer_order, l->rsp.slot_stride);
+}
+
+#endif
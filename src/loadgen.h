@@ -0,0 +1,199 @@
+#ifndef __LOADGEN_H__
+#define __LOADGEN_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "counter.h"
+#include "poll.h"
+#include "client.h"
+#include "histogram.h"
+
+/*
+ * Open-loop load generator.
+ *
+ * The client benchmarks elsewhere are closed-loop: a request goes out when
+ * the window has room, so once the receiver falls behind the sender slows
+ * down with it and the queueing delay never shows up in the latencies.
+ * Here requests are sent on a schedule fixed in advance instead, at a
+ * constant rate or with Poisson arrivals, and each round trip is timed
+ * from the intended send time with client_submit_at(). Time spent waiting
+ * for the window, or sent late behind an earlier request, is counted.
+ *
+ * load_sweep() first measures the closed-loop capacity of the channel, then
+ * offers load at each of load_percent[] of it and prints a CSV row per
+ * step. The knee is the last step before the p99 latency grows by more
+ * than LOAD_KNEE_FACTOR over the lightest load, or the channel stops
+ * keeping up with the offered rate.
+ */
+
+#define LOAD_CONSTANT 0
+#define LOAD_POISSON  1
+
+#define LOAD_ARRIVALS_NAME(arrivals) ((arrivals) == LOAD_POISSON ? "poisson" : "constant")
+
+#ifndef LOAD_ITER
+#define LOAD_ITER 100000
+#endif
+
+#define LOAD_KNEE_FACTOR 4
+
+static const unsigned load_percent[] = {10, 25, 50, 70, 80, 90, 95, 100, 110, 125};
+
+struct loadgen {
+    int arrivals;
+    double gap;     /* mean ticks between intended sends */
+    uint64_t rng;   /* xorshift64* state, never 0 */
+    uint64_t paced; /* ticks load_run() spun waiting for intended send times */
+};
+
+static inline void load_init(struct loadgen *g, int arrivals, double gap) {
+    g->arrivals = arrivals;
+    g->gap = gap;
+    g->rng = 0x9e3779b97f4a7c15ULL;
+    g->paced = 0;
+}
+
+static inline uint64_t load_random(struct loadgen *g) {
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 0x2545f4914f6cdd1dULL;
+}
+
+/*
+ * -ln(u) for u = r / 2^64, an exponentially distributed value with mean 1.
+ * log2 of the mantissa is found a bit at a time by squaring, so no libm.
+ */
+static inline double load_exp(uint64_t r) {
+    double m, bit, log2 = 0;
+    int shift;
+
+    if (r == 0) {
+        r = 1;
+    }
+    shift = __builtin_clzll(r);
+    m = (double)(r << shift) / 9223372036854775808.0;
+    for (bit = 0.5; bit > 1e-6; bit /= 2) {
+        m *= m;
+        if (m >= 2) {
+            m /= 2;
+            log2 += bit;
+        }
+    }
+    return (shift + 1 - log2) * 0.6931471805599453;
+}
+
+/* ticks from one intended send to the next */
+static inline double load_gap(struct loadgen *g) {
+    if (g->arrivals == LOAD_POISSON) {
+        return g->gap * load_exp(load_random(g));
+    }
+    return g->gap;
+}
+
+static inline void load_complete(void *arg, const struct msg *rsp) {
+}
+
+/*
+ * Send count requests on g's schedule, returns the ticks until the last
+ * completed. The sender spins until each intended send time, and adds the
+ * ticks it spent so to g->paced, so that CPU time measured around a run
+ * can be told apart from the cost of the messages.
+ */
+static inline uint64_t load_run(struct loadgen *g, struct client *c, unsigned long count) {
+    struct msg msg = {0};
+    uint64_t start = poll_now(), at, now;
+    double next = start;
+
+    for (unsigned long i = 0; i < count; i++) {
+        at = (uint64_t)next;
+        now = poll_now();
+        if ((int64_t)(now - at) < 0) {
+            while ((int64_t)(poll_now() - at) < 0) {
+                poll_pause();
+            }
+            g->paced += poll_now() - now;
+        }
+        msg.word[1] = i;
+        client_submit_at(c, &msg, load_complete, NULL, at);
+        next += load_gap(g);
+    }
+    client_drain(c);
+    return poll_now() - start;
+}
+
+/* requests per second at ticks per request, or 0 if the frequency is unknown */
+static inline unsigned long load_rate(double ticks) {
+    uint64_t hz = counter_calibration()->hz;
+
+    return ticks > 0 ? (unsigned long)(hz / ticks) : 0;
+}
+
+/*
+ * Closed-loop capacity in ticks per request, with the window kept full.
+ * Leaves c sending one request at a time, as load_run() does, with no rtt.
+ */
+static inline double load_capacity(struct client *c) {
+    struct msg msg = {0};
+    uint64_t start;
+
+    client_set_window(c, CLIENT_MAX_WINDOW);
+    client_set_batch(c, 1);
+    c->rtt = NULL;
+
+    start = poll_now();
+    for (unsigned long i = 0; i < LOAD_ITER; i++) {
+        client_submit(c, &msg, load_complete, NULL);
+    }
+    client_drain(c);
+    return (double)(poll_now() - start) / LOAD_ITER;
+}
+
+/* rtt is used for the latencies of every step, and left attached to c */
+static inline void load_sweep(struct client *c, struct histogram *rtt, int arrivals) {
+    struct loadgen g;
+    double capacity, gap, achieved, knee_gap = 0;
+    uint64_t base_p99 = 0, p99;
+    unsigned knee = 0;
+    int saturated = 0;
+    char name[32];
+
+    capacity = load_capacity(c);
+    c->rtt = rtt;
+
+    printf("load,arrivals,percent,gap_ticks,ticks_per_msg,offered_msgs_per_sec,"
+           "achieved_msgs_per_sec,p50,p90,p99,p999,max\n");
+    for (size_t i = 0; i < sizeof(load_percent) / sizeof(load_percent[0]); i++) {
+        gap = capacity * 100 / load_percent[i];
+        load_init(&g, arrivals, gap);
+        hist_init(rtt);
+        achieved = (double)load_run(&g, c, LOAD_ITER) / LOAD_ITER;
+        p99 = hist_percentile(rtt, 990000);
+
+        printf("load,%s,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+            LOAD_ARRIVALS_NAME(arrivals), load_percent[i], (unsigned long)gap,
+            (unsigned long)achieved, load_rate(gap), load_rate(achieved),
+            (unsigned long)hist_percentile(rtt, 500000), (unsigned long)hist_percentile(rtt, 900000),
+            (unsigned long)p99, (unsigned long)hist_percentile(rtt, 999000),
+            (unsigned long)rtt->max);
+        snprintf(name, sizeof(name), "load_%s_%u", LOAD_ARRIVALS_NAME(arrivals), load_percent[i]);
+        hist_print(rtt, name);
+
+        if (i == 0) {
+            base_p99 = p99;
+        }
+        if (!saturated && (p99 > LOAD_KNEE_FACTOR * base_p99 || achieved > gap * 1.05)) {
+            saturated = 1;
+        }
+        if (!saturated) {
+            knee = load_percent[i];
+            knee_gap = gap;
+        }
+    }
+
+    printf("load knee %s: %u%% of capacity, %lu ticks per msg, %lu msgs/s\n",
+        LOAD_ARRIVALS_NAME(arrivals), knee, (unsigned long)knee_gap, load_rate(knee_gap));
+}
+
+#endif
@@ -39,12 +39,28 @@
 
 
 #include "../src/ring.h"
+#include "../src/transport.h"
 #include "../src/counter.h"
+#include "../src/poll.h"
+#include "../src/client.h"
+#include "../src/receiver.h"
+#include "../src/histogram.h"
+#include "../src/loadgen.h"
+#include "../src/kbench.h"
+#include "../src/ipc.h"
 
 /* constants */
-#define EP_BADGE1 0x61 // arbitrary (but unique) number for a badge
-#define EP_BADGE2 0x62 // arbitrary (but unique) number for a badge
-#define SEM_BADGE 0x63
+
+/*
+ * Every thread sleeps on a single notification, and the badge bit of each
+ * signal says which ring it is about. Signals to one notification coalesce,
+ * and a woken thread re-checks all its rings.
+ */
+#define REQ_DOORBELL_BADGE BIT(0) /* app: requests posted */
+#define RSP_CREDIT_BADGE   BIT(1) /* app: response slots returned */
+#define REQ_CREDIT_BADGE   BIT(0) /* main: request slots returned */
+#define DONE_BADGE         BIT(1) /* main: the receiver completed requests */
+#define RSP_DOORBELL_BADGE BIT(0) /* receiver: responses posted */
 
 #define IPCBUF_FRAME_SIZE_BITS 12 // use a 4K frame for the IPC buffer
 #define IPCBUF_VADDR 0x7000000 // arbitrary (but free) address for IPC buffer
@@ -52,6 +68,15 @@
 #define APP_PRIORITY seL4_MaxPrio
 #define APP_IMAGE_NAME "app"
 
+/* core app runs on for the ring benchmarks, main stays on core 0 */
+#ifndef APP_CORE
+#define APP_CORE 0
+#endif
+
+/* the shared region is mapped in frames of MAP_BITS, see ring.h */
+_Static_assert(MAP_BITS == seL4_PageBits || MAP_BITS == seL4_LargePageBits,
+               "MAP_BITS must be a frame size of this architecture");
+
 /* global environment variables */
 seL4_BootInfo *info;
 simple_t simple;
@@ -82,18 +107,54 @@ static struct aring *req_aring = NULL;
 static struct aring *rsp_aring = NULL;
 static void *req_data_buf = NULL;
 static void *rsp_data_buf = NULL;
+#ifdef RING_STATS
+static struct stats_page *stats_page = NULL; /* shared with app */
+#endif
+#ifdef RING_TRACE
+static struct trace_area *trace_area = NULL; /* shared with app */
+#endif
+#ifdef RING_PMU
+static struct pmu_block *pmu_block = NULL; /* written by app */
+static struct pmu pmu;
+#endif
+
+static struct transport req_tp; /* sending end of the request channel */
+static struct transport rsp_tp; /* receiving end of the response channel */
+static struct poller rsp_poll;
+static struct client client; /* issues requests over req_tp */
+
+static seL4_CPtr receiver_tcb;
+static seL4_CPtr app_tcb;
+
+/* notifications main and the receiver thread sleep on */
+static vka_object_t main_ntfn_object;
+static vka_object_t receiver_ntfn_object;
+
+static cspacepath_t req_doorbell_cap_path;
+static cspacepath_t rsp_doorbell_cap_path;
+static cspacepath_t done_cap_path;
+static cspacepath_t req_credit_cap_path;
+static cspacepath_t rsp_credit_cap_path;
+static vka_object_t ipc_ep_object;
 
-static cspacepath_t sender_ep_cap_path;
-static cspacepath_t receiver_ep_cap_path;
-static cspacepath_t sem_cap_path;
-
-static uint64_t sem_down_overhead = 0;
-static uint64_t sem_up_overhead = 0;
 static uint64_t start, end;
 #define ITER 1000000
 
+/* scratch ring for the single-threaded ring micro-benchmark */
+static _Alignas(LFRING_ALIGN) char bench_ring[RING_BYTES(RING_WCQ, FRING_ORDER)];
+
 static void init_rings(void *shared_mem) {
-    printf("Main: init_rings SHARED_PAGES: %ld\n", SHARED_PAGES);
+    printf("Main: init_rings SHARED_PAGES: %ld, %s pages\n", SHARED_PAGES, RING_PAGING);
+    printf("Main: req_fring %s, rsp_fring %s, req_aring %s, rsp_aring %s\n",
+        FRING_NAME(REQ_FRING_TYPE), FRING_NAME(RSP_FRING_TYPE),
+        ARING_NAME(REQ_ARING_TYPE), ARING_NAME(RSP_ARING_TYPE));
+    printf("Main: poll mode %s, replies %s, slot stride req %u rsp %u, prefetch %d\n",
+        POLL_MODE_NAME(POLL_MODE), RING_REPLIES, (unsigned)REQ_SLOT_STRIDE,
+        (unsigned)RSP_SLOT_STRIDE, RING_PREFETCH);
+
+    /* app finds everything below through the header */
+    layout_init(LAYOUT(shared_mem));
+    layout_print("Main", LAYOUT(shared_mem));
 
     req_fring = REQ_FRING(shared_mem);
     rsp_fring = RSP_FRING(shared_mem);
@@ -103,98 +164,317 @@ static void init_rings(void *shared_mem) {
     rsp_data_buf = RSP_DATA_BUF(shared_mem);
 
     /* init ring */
-    lfring_init_fill((struct lfring *)req_fring->ring, 0, BUFFER_SIZE, RING_ORDER);
-    lfring_init_fill((struct lfring *)rsp_fring->ring, 0, BUFFER_SIZE, RING_ORDER);
-    lfring_init_empty((struct lfring *)req_aring->ring, RING_ORDER);
-    lfring_init_empty((struct lfring *)rsp_aring->ring, RING_ORDER);
-
+    req_chan_init(req_fring, req_aring, REQ_BUFFER_SIZE);
+#ifdef RING_INPLACE
+    /* responses come back in the request slots, rsp_fring is req_fring */
+    ring_init_empty(RSP_ARING_TYPE, rsp_aring->ring, RSP_RING_ORDER);
+#else
+    rsp_chan_init(rsp_fring, rsp_aring, RSP_BUFFER_SIZE);
+#endif
+
+#ifndef RING_INLINE
     atomic_init(&req_fring->readers, 1);
     atomic_init(&rsp_fring->readers, 1);
-    atomic_init(&req_aring->readers, 0);
-    atomic_init(&rsp_aring->readers, 0);
+#endif
+    atomic_init(&req_aring->event, 0);
+    atomic_init(&rsp_aring->event, 0);
+    atomic_init(&req_aring->posted, 0);
+    atomic_init(&rsp_aring->posted, 0);
+    atomic_init(&req_aring->full, 0);
+    atomic_init(&rsp_aring->full, 0);
+    req_aring->waits = req_aring->signals = 0;
+    rsp_aring->waits = rsp_aring->signals = 0;
+    atomic_init(&req_aring->poll_mode, POLL_MODE);
+    atomic_init(&rsp_aring->poll_mode, POLL_MODE);
+
+    transport_init(&req_tp, req_fring, req_aring, req_data_buf,
+                   req_doorbell_cap_path.capPtr, req_credit_cap_path.capPtr);
+    transport_init(&rsp_tp, rsp_fring, rsp_aring, rsp_data_buf,
+                   seL4_CapNull, rsp_credit_cap_path.capPtr);
+    poll_init(&rsp_poll, &rsp_aring->poll_mode);
+
+#ifdef RING_STATS
+    stats_page = STATS(shared_mem);
+    stats_init(stats_page);
+    transport_set_stats(&req_tp, &stats_page->req_send);
+    transport_set_stats(&rsp_tp, &stats_page->rsp_recv);
+#endif
+#ifdef RING_TRACE
+    trace_area = TRACE_AREA(shared_mem);
+    trace_init(trace_area);
+    transport_set_trace(&req_tp, &trace_area->req_send);
+    transport_set_trace(&rsp_tp, &trace_area->rsp_recv);
+#endif
+#ifdef RING_PMU
+    pmu_block = PMU_BLOCK(shared_mem);
+    pmu_block_init(pmu_block);
+#endif
 }
 
-static void send_message(unsigned long message) {
-    unsigned long idx;
-    unsigned long *slot;
+/* cycles per dequeue + enqueue pair on a full ring, batch entries at a time */
+static uint64_t bench_ring_op(int type, size_t batch) {
+    size_t idx[RING_BATCH];
+    uint64_t t0, t1;
+
+    ring_init_fill(type, bench_ring, 0, BUFFER_SIZE, FRING_ORDER);
 
-    while ((idx = lfring_dequeue((struct lfring *) req_fring->ring, RING_ORDER, false)) == LFRING_EMPTY) {
-        /* spin for available idx from free ring */
+    READ_COUNTER_BEFORE(t0);
+    for (unsigned long i = 0; i < ITER; i += batch) {
+        size_t n = ring_dequeue_batch(type, bench_ring, FRING_ORDER, idx, batch, NULL);
+        ring_enqueue_batch(type, bench_ring, FRING_ORDER, idx, n, NULL);
     }
+    READ_COUNTER_AFTER(t1);
 
-    slot = (unsigned long *)((char *)req_data_buf + idx * DATA_SLOT_SIZE);
-    slot[0] = message;
-    slot[1] = message + 1;
-    slot[2] = message + 2;
-    slot[3] = message + 3;
+    return counter_elapsed(t0, t1) / ITER;
+}
+
+static void bench_rings(void) {
+    printf("ring: batch 1, scq: %lu, spsc: %lu, wcq: %lu cycles per message\n",
+        bench_ring_op(RING_SCQ, 1), bench_ring_op(RING_SPSC, 1), bench_ring_op(RING_WCQ, 1));
+    printf("ring: batch %u, scq: %lu, spsc: %lu, wcq: %lu cycles per message\n", RING_BATCH,
+        bench_ring_op(RING_SCQ, RING_BATCH), bench_ring_op(RING_SPSC, RING_BATCH),
+        bench_ring_op(RING_WCQ, RING_BATCH));
+}
 
-    lfring_enqueue((struct lfring *)req_aring->ring, RING_ORDER, idx, false);
+/* objects for the wakeup ping-pong between main and the receiver thread */
+#define WAKEUP_ITER 10000
+static vka_object_t wakeup_ep[2];
+static vka_object_t wakeup_ntfn[2];
 
-    if (atomic_load(&req_aring->readers) <= 0) {
-        seL4_Signal(sender_ep_cap_path.capPtr);
+static void alloc_wakeup_objects(void) {
+    UNUSED int error;
+
+    for (int i = 0; i < 2; i++) {
+        error = vka_alloc_endpoint(&vka, &wakeup_ep[i]);
+        assert(error == 0);
+        error = vka_alloc_notification(&vka, &wakeup_ntfn[i]);
+        assert(error == 0);
     }
 }
 
-static void receive_message(unsigned long m0, unsigned long m1, unsigned long m2, unsigned long m3) {
-    uint64_t up_start, up_end;
-
-    READ_COUNTER_BEFORE(up_start);
-    seL4_Signal(sem_cap_path.capPtr);
-    READ_COUNTER_AFTER(up_end);
-    sem_up_overhead += (up_end - up_start);
-
-    /* sanity check */
-    assert(m1 == m0 + 1 && m2 == m1 + 1 && m3 == m2 + 1);
-
-    if (m0 == ITER-1) {
-        READ_COUNTER_AFTER(end);
-        printf("message: (%lu, %lu, %lu, %lu), ITER: %u, overhead: %lu, cycle: %lu\n",
-            m0, m1, m2, m3, ITER,
-            (sem_up_overhead + sem_down_overhead)/ITER,
-            (end - start - sem_up_overhead - sem_down_overhead)/ITER);
-    } else if (m0 == ITER) {
-        assert(false);
+/* the receiver thread's side of bench_wakeups() */
+static void bench_wakeups_peer(void) {
+    for (unsigned long i = 0; i < WAKEUP_ITER; i++) {
+        seL4_Recv(wakeup_ep[0].cptr, NULL);
+        seL4_Send(wakeup_ep[1].cptr, seL4_MessageInfo_new(0, 0, 0, 0));
+    }
+    for (unsigned long i = 0; i < WAKEUP_ITER; i++) {
+        seL4_Wait(wakeup_ntfn[0].cptr, NULL);
+        seL4_Signal(wakeup_ntfn[1].cptr);
     }
 }
 
-static void receiver(void) {
-    unsigned long idx;
-    unsigned long fails = 0;
-    unsigned long *slot;
-
-    assert(receiver_ep_cap_path.capPtr != 0);
-    assert(req_fring != NULL);
-
-start_over:
-    atomic_store(&rsp_aring->readers, 1);
-    fails = 0;
-again:
-    while ((idx = lfring_dequeue((struct lfring *)rsp_aring->ring,
-        RING_ORDER, false)) != LFRING_EMPTY) {
-retry:
-        fails = 0;
-
-        slot = (unsigned long *)((char *)rsp_data_buf + idx * DATA_SLOT_SIZE);
-        receive_message(slot[0], slot[1], slot[2], slot[3]);
-
-        lfring_enqueue((struct lfring *) rsp_fring->ring,
-            RING_ORDER, idx, false);
+/* cycles to wake a blocked thread, each round trip being two wakeups */
+static void bench_wakeups(void) {
+    uint64_t t0, t1, t2, t3;
+
+    READ_COUNTER_BEFORE(t0);
+    for (unsigned long i = 0; i < WAKEUP_ITER; i++) {
+        seL4_Send(wakeup_ep[0].cptr, seL4_MessageInfo_new(0, 0, 0, 0));
+        seL4_Recv(wakeup_ep[1].cptr, NULL);
     }
-    if (++fails < 1024) {
-        goto again;
+    READ_COUNTER_AFTER(t1);
+    READ_COUNTER_BEFORE(t2);
+    for (unsigned long i = 0; i < WAKEUP_ITER; i++) {
+        seL4_Signal(wakeup_ntfn[0].cptr);
+        seL4_Wait(wakeup_ntfn[1].cptr, NULL);
     }
-    atomic_store(&rsp_aring->readers, -1);
+    READ_COUNTER_AFTER(t3);
+
+    printf("wakeup: endpoint %lu, notification %lu cycles\n",
+        counter_elapsed(t0, t1) / (2 * WAKEUP_ITER), counter_elapsed(t2, t3) / (2 * WAKEUP_ITER));
+}
+
+/*
+ * The client benchmark sweeps every pair of the windows and batch sizes
+ * below with SWEEP_ITER requests each, and prints a CSV row per pair. The
+ * ring orders, slot size, ring types and reply mode are fixed at build
+ * time and are printed as columns, so the rows of differently configured
+ * builds can be concatenated into one table.
+ *
+ * The number of producers is not swept: it is always one. Each end of a
+ * channel belongs to one thread, the free rings and the default arings are
+ * SPSC rings, and a struct client is not shared between threads. Putting
+ * several submitters on one channel would need multi-producer rings and a
+ * shared credit pool, so it is out of scope here. tools/ring_latency.c
+ * measures the rings themselves under many producers.
+ */
+#ifndef SWEEP_ITER
+#define SWEEP_ITER 100000
+#endif
+
+static const size_t sweep_window[] = {1, 8, 64, 512};
+static const size_t sweep_batch[] = {1, 4, 16, RING_BATCH};
+static struct histogram sweep_rtt;
+
+static void sweep_complete(void *arg, const struct msg *rsp) {
+    /* sanity check, on the words that travel */
+#if !defined(RING_INLINE) || INLINE_WORDS == 4
+    assert(rsp->word[2] == rsp->word[1] + 1 && rsp->word[3] == rsp->word[2] + 1);
+#endif
+}
+
+static void sweep_cell(size_t window, size_t batch) {
+    struct msg msg = {0};
+    uint64_t cycles, hz = counter_calibration()->hz;
+    char name[32];
+#ifdef RING_PMU
+    struct pmu_sample main0, main1, app0, app1;
+#endif
+
+    client_set_window(&client, window);
+    client_set_batch(&client, batch);
+    hist_init(&sweep_rtt);
+    client.rtt = &sweep_rtt;
+
+#ifdef RING_PMU
+    pmu_snapshot(pmu_block, client.issued, &app0);
+    pmu_read(&pmu, &main0);
+#endif
+    READ_COUNTER_BEFORE(start);
+    for (unsigned long i = 0; i < SWEEP_ITER; i++) {
+        msg.word[1] = i;
+#if !defined(RING_INLINE) || INLINE_WORDS == 4
+        msg.word[2] = i + 1;
+        msg.word[3] = i + 2;
+#endif
+        client_submit(&client, &msg, sweep_complete, NULL);
+    }
+    client_drain(&client);
+    READ_COUNTER_AFTER(end);
+    cycles = counter_elapsed(start, end);
+#ifdef RING_PMU
+    pmu_read(&pmu, &main1);
+    pmu_snapshot(pmu_block, client.issued, &app1);
+#endif
+
+    printf("sweep,%u,%u,%u,%u,%u,%u,%d,%s,%s,%s,%s,%zu,%zu,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+        REQ_RING_ORDER, REQ_BUFFER_ORDER, RSP_RING_ORDER, RSP_BUFFER_ORDER,
+        (unsigned)sizeof(struct msg), (unsigned)REQ_SLOT_STRIDE,
+        RING_PREFETCH, RING_PAGING,
+        FRING_NAME(REQ_FRING_TYPE), ARING_NAME(REQ_ARING_TYPE), RING_REPLIES,
+        batch, window, SWEEP_ITER, cycles / SWEEP_ITER, counter_ns(cycles) / SWEEP_ITER,
+        cycles != 0 ? (unsigned long)(SWEEP_ITER * hz / cycles) : 0,
+        hist_percentile(&sweep_rtt, 500000), hist_percentile(&sweep_rtt, 900000),
+        hist_percentile(&sweep_rtt, 990000), hist_percentile(&sweep_rtt, 999000),
+        sweep_rtt.max);
+    snprintf(name, sizeof(name), "rtt_w%zu_b%zu", window, batch);
+    hist_print(&sweep_rtt, name);
+#ifdef RING_PMU
+    snprintf(name, sizeof(name), "w%zu_b%zu_main", window, batch);
+    pmu_print(name, &main0, &main1, SWEEP_ITER);
+    snprintf(name, sizeof(name), "w%zu_b%zu_app", window, batch);
+    pmu_print(name, &app0, &app1, SWEEP_ITER);
+#endif
+}
+
+static void bench_sweep(void) {
+    printf("sweep,ring_order,buffer_order,rsp_ring_order,rsp_buffer_order,slot_size,stride,prefetch,"
+           "paging,fring,aring,replies,"
+           "batch,window,requests,cycles_per_msg,ns_per_msg,msgs_per_sec,p50,p90,p99,p999,max\n");
+    for (size_t w = 0; w < ARRAY_SIZE(sweep_window); w++) {
+        for (size_t b = 0; b < ARRAY_SIZE(sweep_batch); b++) {
+            sweep_cell(sweep_window[w], sweep_batch[b]);
+        }
+    }
+
+    printf("doorbells: req sent %lu needed %lu, rsp sent %lu needed %lu\n",
+        req_aring->signals, req_aring->waits, rsp_aring->signals, rsp_aring->waits);
+}
+
+/*
+ * The same echo over native IPC (ipc.h), with app on main's core and, on
+ * SMP kernels, on the next one. app is then left on APP_CORE for the ring
+ * benchmarks.
+ */
+static struct histogram ipc_rtt;
+
+static void bench_ipc(void) {
+    UNUSED int error;
+
+    ipc_sweep(ipc_ep_object.cptr, "same_core", &ipc_rtt);
+#if CONFIG_MAX_NUM_NODES > 1
+    error = seL4_TCB_SetAffinity(app_tcb, 1);
+    assert(error == 0);
+    ipc_sweep(ipc_ep_object.cptr, "cross_core", &ipc_rtt);
+#endif
+    ipc_done(ipc_ep_object.cptr);
+
+#if CONFIG_MAX_NUM_NODES > 1
+    error = seL4_TCB_SetAffinity(app_tcb, APP_CORE);
+    assert(error == 0);
+#endif
+    printf("Main: app on core %d\n", APP_CORE);
+}
+
+/* open-loop latency against offered load, see loadgen.h */
+static struct histogram load_rtt;
+
+static void bench_load(void) {
+    load_sweep(&client, &load_rtt, LOAD_CONSTANT);
+    load_sweep(&client, &load_rtt, LOAD_POISSON);
+    client.rtt = NULL;
+}
 
-    idx = lfring_dequeue((struct lfring *)rsp_aring->ring,
-        RING_ORDER, false);
-    if (idx != LFRING_EMPTY) {
-        atomic_store(&rsp_aring->readers, 1);
-        goto retry;
+#ifdef KBENCH
+/*
+ * Kernel entries and CPU time per message (kbench.h) at a few constant
+ * offered loads, in every poll mode. KBENCH_ITER is kept small enough for
+ * the kernel entry log to hold a whole step; log_full in a row means it
+ * did not and entries_per_msg is a floor. main busy-waits between sends,
+ * so its cycles include the pacing_ticks_per_msg of the row.
+ */
+#ifndef KBENCH_ITER
+#define KBENCH_ITER 10000
+#endif
+
+static const int kbench_mode[] = {POLL_BUSY, POLL_HYBRID, POLL_NOTIFY};
+static const unsigned kbench_percent[] = {10, 50, 90};
+static struct kbench kbench;
+
+static void bench_kernel(void) {
+    struct loadgen g;
+    double capacity;
+    char label[32];
+
+    kbench_init(&kbench, &vka);
+    kbench_add_thread(&kbench, "main", simple_get_tcb(&simple));
+    kbench_add_thread(&kbench, "receiver", receiver_tcb);
+    kbench_add_thread(&kbench, "app", app_tcb);
+    kbench_print_header(&kbench);
+
+    for (size_t m = 0; m < ARRAY_SIZE(kbench_mode); m++) {
+        /* both receivers pick the mode up the next time their ring runs empty */
+        atomic_store(&req_aring->poll_mode, kbench_mode[m]);
+        poll_set_mode(&rsp_poll, kbench_mode[m]);
+        capacity = load_capacity(&client);
+
+        for (size_t p = 0; p < ARRAY_SIZE(kbench_percent); p++) {
+            load_init(&g, LOAD_CONSTANT, capacity * 100 / kbench_percent[p]);
+            kbench_start(&kbench);
+            load_run(&g, &client, KBENCH_ITER);
+            kbench_stop(&kbench);
+            snprintf(label, sizeof(label), "%s_%u", POLL_MODE_NAME(kbench_mode[m]),
+                     kbench_percent[p]);
+            kbench_print(&kbench, label, KBENCH_ITER, g.paced);
+        }
     }
 
-    seL4_Wait(receiver_ep_cap_path.capPtr, NULL);
+    atomic_store(&req_aring->poll_mode, POLL_MODE);
+    poll_set_mode(&rsp_poll, POLL_MODE);
+}
+#endif
 
-    goto start_over;
+static void receiver(void) {
+    struct receiver r;
+
+    assert(rsp_doorbell_cap_path.capPtr != 0);
+    assert(req_aring != NULL);
+
+    bench_wakeups_peer();
+
+    receiver_init(&r, &rsp_tp, &rsp_poll, rsp_doorbell_cap_path.capPtr, NULL);
+    receiver_complete(&r, &client);
 }
 
 static void create_receiver_thread(void) {
@@ -251,6 +531,7 @@ static void create_receiver_thread(void) {
     assert(error == 0);
 
     NAME_THREAD(tcb_object.cptr, "main: receiver");
+    receiver_tcb = tcb_object.cptr;
 
     /* set start up registers for the new thread */
     UNUSED seL4_UserContext regs = {0};
@@ -283,13 +564,8 @@ static void create_receiver_thread(void) {
     assert(error == 0);
 
 
-    /* allocate a semaphore */
-    static vka_object_t sem_object = {0};
-    error = vka_alloc_endpoint(&vka, &sem_object);
-    assert(error == 0);
-
-    /* badge the semaphore */
-    error = vka_mint_object(&vka, &sem_object, &sem_cap_path, seL4_AllRights, SEM_BADGE);
+    /* the receiver tells main about completions through main's notification */
+    error = vka_mint_object(&vka, &main_ntfn_object, &done_cap_path, seL4_AllRights, DONE_BADGE);
     assert(error == 0);
 
     /* start the new thread running */
@@ -310,55 +586,91 @@ void static create_process(void) {
 
     /* give the new process's thread a name */
     NAME_THREAD(new_process.thread.tcb.cptr, "app");
+    app_tcb = new_process.thread.tcb.cptr;
 
-    /* create an endpoint for sender */
-    vka_object_t sender_ep_object = {0};
-    error = vka_alloc_endpoint(&vka, &sender_ep_object);
+    /* create one notification for each of app, main and the receiver thread */
+    vka_object_t app_ntfn_object = {0};
+    error = vka_alloc_notification(&vka, &app_ntfn_object);
     assert(error == 0);
 
-    /* create an endpoint for receiver */
-    vka_object_t receiver_ep_object = {0};
-    error = vka_alloc_endpoint(&vka, &receiver_ep_object);
+    error = vka_alloc_notification(&vka, &main_ntfn_object);
     assert(error == 0);
 
-    /*
-     * make a badged endpoint in the new process's cspace.  This copy
-     * will be used to send an IPC to the original cap
-     */
+    error = vka_alloc_notification(&vka, &receiver_ntfn_object);
+    assert(error == 0);
 
-    /* make a cspacepath for the new sender's endpoint cap */
-    seL4_CPtr sender_ep_cap = 0;
-    vka_cspace_make_path(&vka, sender_ep_object.cptr, &sender_ep_cap_path);
+    /* app sleeps on its notification for both requests and response slots */
+    cspacepath_t app_ntfn_cap_path;
+    vka_cspace_make_path(&vka, app_ntfn_object.cptr, &app_ntfn_cap_path);
+    seL4_CPtr app_ntfn_cap = sel4utils_mint_cap_to_process(&new_process, app_ntfn_cap_path,
+                                                            seL4_AllRights, seL4_NilData);
+    assert(app_ntfn_cap != 0);
 
-    /* copy the endpoint cap and add a badge to the new cap */
-    sender_ep_cap = sel4utils_mint_cap_to_process(&new_process, sender_ep_cap_path, seL4_AllRights, EP_BADGE1);
-    assert(sender_ep_cap != 0);
+    /* main signals it with a badge per ring */
+    error = vka_mint_object(&vka, &app_ntfn_object, &req_doorbell_cap_path, seL4_AllRights,
+                            REQ_DOORBELL_BADGE);
+    assert(error == 0);
+#ifdef RING_INPLACE
+    /* the receiver thread hands request slots back to main itself */
+    error = vka_mint_object(&vka, &main_ntfn_object, &rsp_credit_cap_path, seL4_AllRights,
+                            REQ_CREDIT_BADGE);
+#else
+    error = vka_mint_object(&vka, &app_ntfn_object, &rsp_credit_cap_path, seL4_AllRights,
+                            RSP_CREDIT_BADGE);
+#endif
+    assert(error == 0);
+
+    /* app signals main for request slots and the receiver thread for responses */
+    vka_cspace_make_path(&vka, main_ntfn_object.cptr, &req_credit_cap_path);
+    seL4_CPtr req_credit_cap = sel4utils_mint_cap_to_process(&new_process, req_credit_cap_path,
+                                                              seL4_AllRights, REQ_CREDIT_BADGE);
+    assert(req_credit_cap != 0);
 
-    /* make a cspacepath for the new receiver's endpoint cap */
-    seL4_CPtr receiver_ep_cap = 0;
-    vka_cspace_make_path(&vka, receiver_ep_object.cptr, &receiver_ep_cap_path);
+    vka_cspace_make_path(&vka, receiver_ntfn_object.cptr, &rsp_doorbell_cap_path);
+    seL4_CPtr rsp_doorbell_cap = sel4utils_mint_cap_to_process(&new_process, rsp_doorbell_cap_path,
+                                                                seL4_AllRights, RSP_DOORBELL_BADGE);
+    assert(rsp_doorbell_cap != 0);
 
-    /* copy the endpoint cap and add a badge to the new cap */
-    receiver_ep_cap = sel4utils_mint_cap_to_process(&new_process, receiver_ep_cap_path, seL4_AllRights, EP_BADGE2);
-    assert(receiver_ep_cap != 0);
+    /* main calls app on an endpoint for the native IPC baseline */
+    error = vka_alloc_endpoint(&vka, &ipc_ep_object);
+    assert(error == 0);
+    cspacepath_t ipc_ep_cap_path;
+    vka_cspace_make_path(&vka, ipc_ep_object.cptr, &ipc_ep_cap_path);
+    seL4_CPtr ipc_ep_cap = sel4utils_mint_cap_to_process(&new_process, ipc_ep_cap_path,
+                                                          seL4_AllRights, seL4_NilData);
+    assert(ipc_ep_cap != 0);
 
     /* set up shared memory */
-    void *shared_mem = vspace_new_pages(&vspace, seL4_AllRights, SHARED_PAGES, seL4_PageBits);
+    void *shared_mem = vspace_new_pages(&vspace, seL4_AllRights, SHARED_MAPS, MAP_BITS);
     assert(shared_mem != NULL);
 
-    void *app_shared_mem = vspace_share_mem(&vspace, &new_process.vspace, shared_mem, SHARED_PAGES,
-                                            seL4_PageBits, seL4_AllRights, true);
+    void *app_shared_mem;
+    if (RING_SHARED_POINTERS) {
+        /* LSCQ segments are linked by pointer: give app the same address */
+        reservation_t reservation = vspace_reserve_range_at(&new_process.vspace, shared_mem,
+                                                            SHARED_PAGES * PAGE_SIZE, seL4_AllRights, 1);
+        assert(reservation.res != NULL);
+
+        error = sel4utils_share_mem_at_vaddr(&vspace, &new_process.vspace, shared_mem, SHARED_MAPS,
+                                             MAP_BITS, shared_mem, reservation);
+        assert(error == 0);
+        app_shared_mem = shared_mem;
+    } else {
+        app_shared_mem = vspace_share_mem(&vspace, &new_process.vspace, shared_mem, SHARED_MAPS,
+                                          MAP_BITS, seL4_AllRights, true);
+    }
     assert(app_shared_mem != NULL);
 
     /* init ring buffer */
     init_rings(shared_mem);
 
     /* spawn the process */
-    seL4_Word argc = 3;
+    seL4_Word argc = 6;
     char string_args[argc][WORD_STRING_SIZE];
     char* argv[argc];
     int resume = 1;
-    sel4utils_create_word_args(string_args, argv, argc, sender_ep_cap, receiver_ep_cap, app_shared_mem);
+    sel4utils_create_word_args(string_args, argv, argc, app_ntfn_cap, rsp_doorbell_cap, app_shared_mem,
+                               req_credit_cap, app_ntfn_cap, ipc_ep_cap);
 
     error = sel4utils_spawn_process_v(&new_process, &vka, &vspace, argc, (char**) &argv, resume);
     assert(error == 0);
@@ -402,30 +714,53 @@ int main(void) {
     bootstrap_configure_virtual_pool(allocman, vaddr,
                                      ALLOCATOR_VIRTUAL_POOL_SIZE, simple_get_pd(&simple));
 
+    /* calibrate the cycle counter, then compare the ring algorithms */
+    counter_init();
+    printf("counter: %lu Hz, read overhead %lu cycles\n",
+        counter_calibration()->hz, counter_calibration()->overhead);
+#ifdef RING_PMU
+    /* before app starts, which programs the counters of its own core in turn */
+    pmu_open(&pmu, 0);
+    printf("pmu: %s\n", pmu_available(&pmu) ? "counting" : "no counters, pmu rows read 0");
+#endif
+    bench_rings();
+
     /*
      * now create a process
      */
     create_process();
 
+    alloc_wakeup_objects();
+
     /*
      * now create a receiver thread
      */
     create_receiver_thread();
 
+    /* compare wakeups through endpoints and notifications */
+    bench_wakeups();
+
+    /* native IPC echo, for comparison with the rings */
+    bench_ipc();
+
     /* we are done, say hello */
     printf("Main: hello world\n");
 
     //seL4_DebugDumpScheduler();
 
-    uint64_t down_start, down_end;
-    READ_COUNTER_BEFORE(start);
-    for (unsigned long i = 0; i < ITER; i++) {
-        send_message(i);
-        READ_COUNTER_BEFORE(down_start);
-        seL4_Wait(sem_cap_path.capPtr, NULL);
-        READ_COUNTER_AFTER(down_end);
-        sem_down_overhead += (down_end - down_start);
-    }
+    client_init(&client, &req_tp, main_ntfn_object.cptr, done_cap_path.capPtr, 1);
+    bench_sweep();
+    bench_load();
+#ifdef KBENCH
+    bench_kernel();
+#endif
+
+#ifdef RING_STATS
+    stats_print(stats_page);
+#endif
+#ifdef RING_TRACE
+    trace_dump(trace_area);
+#endif
 
     return 0;
 }
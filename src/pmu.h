@@ -0,0 +1,211 @@
+#ifndef __PMU_H__
+#define __PMU_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Performance monitoring counters, compiled in with RING_PMU.
+ *
+ * Five events are counted: L1 data cache misses, last-level cache misses,
+ * branch mispredicts, instructions retired and L1 data TLB misses. pmu_open() sets them up and
+ * pmu_read() returns their running totals; a measurement is the difference
+ * of two reads.
+ *
+ * On seL4 the counters come from sel4bench, which must be linked and needs
+ * the kernel to export the PMU to user level (KernelExportPMCUser). They
+ * count everything on the reading core, so a side only gets figures of its
+ * own when it runs on a core of its own. app cannot be read from main's
+ * core, so app publishes its totals into a struct pmu_block in the shared
+ * region whenever it runs out of requests; pmu_snapshot() gives main the
+ * first totals app published after taking a given number of requests.
+ *
+ * With RING_HOST the counters come from perf_event_open() and count one
+ * thread, which need not be the caller. If the kernel offers no hardware
+ * counters every count reads as 0 and pmu_available() is false.
+ *
+ * The last-level cache event can be changed with -DPMU_LLC_EVENT.
+ */
+
+#define PMU_L1D_MISS     0
+#define PMU_LLC_MISS     1
+#define PMU_BRANCH_MISS  2
+#define PMU_INSTRUCTIONS 3
+#define PMU_DTLB_MISS    4 /* last, so small PMUs keep the events above */
+#define PMU_EVENTS       5
+
+#define PMU_EVENT_NAMES "l1d_miss", "llc_miss", "branch_miss", "instructions", "dtlb_miss"
+
+struct pmu_sample {
+    uint64_t count[PMU_EVENTS];
+};
+
+#ifdef RING_PMU
+
+#ifdef RING_HOST
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#ifndef PMU_LLC_EVENT
+#define PMU_LLC_EVENT PERF_COUNT_HW_CACHE_MISSES
+#endif
+
+struct pmu {
+    int fd[PMU_EVENTS];
+};
+
+/* count the events of thread tid, 0 for the calling thread */
+static inline void pmu_open(struct pmu *p, pid_t tid) {
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } event[PMU_EVENTS] = {
+        [PMU_L1D_MISS] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        [PMU_LLC_MISS] = { PERF_TYPE_HARDWARE, PMU_LLC_EVENT },
+        [PMU_BRANCH_MISS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        [PMU_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        [PMU_DTLB_MISS] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    struct perf_event_attr attr;
+
+    for (int i = 0; i < PMU_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event[i].type;
+        attr.config = event[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        p->fd[i] = syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+    }
+}
+
+static inline int pmu_available(const struct pmu *p) {
+    return p->fd[PMU_INSTRUCTIONS] >= 0;
+}
+
+static inline void pmu_read(struct pmu *p, struct pmu_sample *s) {
+    for (int i = 0; i < PMU_EVENTS; i++) {
+        if (p->fd[i] < 0 || read(p->fd[i], &s->count[i], sizeof(s->count[i])) !=
+                            sizeof(s->count[i])) {
+            s->count[i] = 0;
+        }
+    }
+}
+
+#else
+
+#include <sel4bench/sel4bench.h>
+
+#ifndef PMU_LLC_EVENT
+#if defined(CONFIG_ARCH_X86)
+#define PMU_LLC_EVENT SEL4BENCH_IA32_EVENT_LLC_MISS
+#else
+#define PMU_LLC_EVENT 0x17 /* ARMv8 L2D_CACHE_REFILL */
+#endif
+#endif
+
+struct pmu {
+    int counters; /* counters in use, fewer than PMU_EVENTS on small PMUs */
+};
+
+/* counts the current core; tid is only meaningful on the host */
+static inline void pmu_open(struct pmu *p, int tid) {
+    static const event_id_t event[PMU_EVENTS] = {
+        [PMU_L1D_MISS] = SEL4BENCH_EVENT_CACHE_L1D_MISS,
+        [PMU_LLC_MISS] = PMU_LLC_EVENT,
+        [PMU_BRANCH_MISS] = SEL4BENCH_EVENT_BRANCH_MISPREDICT,
+        [PMU_INSTRUCTIONS] = SEL4BENCH_EVENT_EXECUTE_INSTRUCTION,
+        [PMU_DTLB_MISS] = SEL4BENCH_EVENT_TLB_L1D_MISS,
+    };
+    counter_bitfield_t mask;
+
+    sel4bench_init();
+    p->counters = sel4bench_get_num_counters();
+    if (p->counters > PMU_EVENTS) {
+        p->counters = PMU_EVENTS;
+    }
+    mask = (1U << p->counters) - 1;
+
+    for (int i = 0; i < p->counters; i++) {
+        sel4bench_set_count_event(i, event[i]);
+    }
+    sel4bench_reset_counters();
+    sel4bench_start_counters(mask);
+}
+
+static inline int pmu_available(const struct pmu *p) {
+    return p->counters > 0;
+}
+
+static inline void pmu_read(struct pmu *p, struct pmu_sample *s) {
+    for (int i = 0; i < PMU_EVENTS; i++) {
+        s->count[i] = i < p->counters ? sel4bench_get_counter(i) : 0;
+    }
+}
+
+#endif
+
+/* totals published by a side that main cannot read directly */
+struct pmu_block {
+    _Alignas(LF_CACHE_BYTES) _Atomic(unsigned long) seq; /* odd while writing */
+    unsigned long taken;      /* requests taken when the sample was read */
+    struct pmu_sample sample;
+};
+
+static inline void pmu_block_init(struct pmu_block *b) {
+    atomic_init(&b->seq, 0);
+    b->taken = 0;
+    for (int i = 0; i < PMU_EVENTS; i++) {
+        b->sample.count[i] = 0;
+    }
+}
+
+static inline void pmu_publish(struct pmu_block *b, struct pmu *p, unsigned long taken) {
+    unsigned long seq = atomic_load_explicit(&b->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&b->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    pmu_read(p, &b->sample);
+    b->taken = taken;
+    atomic_store_explicit(&b->seq, seq + 2, memory_order_release);
+}
+
+/* wait until b holds totals read after at least taken requests */
+static inline void pmu_snapshot(struct pmu_block *b, unsigned long taken, struct pmu_sample *s) {
+    unsigned long seq;
+    unsigned long got;
+
+    do {
+        seq = atomic_load_explicit(&b->seq, memory_order_acquire);
+        got = b->taken;
+        *s = b->sample;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) != 0 || atomic_load_explicit(&b->seq, memory_order_relaxed) != seq ||
+             (long)(got - taken) < 0);
+}
+
+#endif
+
+/* print the events per message between two samples, in hundredths */
+static inline void pmu_print(const char *name, const struct pmu_sample *s0,
+                             const struct pmu_sample *s1, unsigned long msgs) {
+    static const char *const event_name[PMU_EVENTS] = { PMU_EVENT_NAMES };
+
+    printf("pmu,%s", name);
+    for (int i = 0; i < PMU_EVENTS; i++) {
+        uint64_t per = msgs != 0 ? (s1->count[i] - s0->count[i]) * 100 / msgs : 0;
+
+        printf(",%s,%lu.%02lu", event_name[i], (unsigned long)(per / 100),
+            (unsigned long)(per % 100));
+    }
+    printf("\n");
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __POLL_H__
+#define __POLL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "counter.h"
+
+/*
+ * How a receiver waits for its aring to fill:
+ *
+ *   POLL_BUSY    poll forever, never sleep (dedicates a core to the ring)
+ *   POLL_HYBRID  poll for a time budget, then sleep on the doorbell
+ *   POLL_NOTIFY  sleep as soon as the ring is empty
+ *
+ * The mode lives in the aring, so either side may switch it at runtime; a
+ * receiver picks up a new mode the next time its ring runs empty.
+ */
+#define POLL_BUSY   0
+#define POLL_HYBRID 1
+#define POLL_NOTIFY 2
+
+#ifndef POLL_MODE
+#define POLL_MODE POLL_HYBRID
+#endif
+
+#define POLL_MODE_NAME(mode) \
+        ((mode) == POLL_BUSY ? "busy" : (mode) == POLL_NOTIFY ? "notify" : "hybrid")
+
+/* bounds of the hybrid spin budget, in TSC cycles */
+#ifndef POLL_MIN_BUDGET
+#define POLL_MIN_BUDGET 2000
+#endif
+#ifndef POLL_MAX_BUDGET
+#define POLL_MAX_BUDGET 200000
+#endif
+
+/* most pause instructions between two polls of an empty ring */
+#define POLL_MAX_BACKOFF 64
+
+/*
+ * In hybrid mode the receiver spins for twice the average time between
+ * arrivals, so that it usually catches the next batch without sleeping.
+ * If arrivals are further apart than the maximum budget allows, spinning
+ * would mostly be wasted and the budget drops to the minimum instead.
+ */
+struct poller {
+    _Atomic(int) *mode;
+    uint64_t budget;   /* current hybrid spin budget */
+    uint64_t gap;      /* moving average of the inter-arrival time */
+    uint64_t last;     /* time of the last arrival */
+    uint64_t deadline; /* end of the current spin, 0 when not spinning */
+    unsigned backoff;  /* pause instructions before the next poll */
+};
+
+static inline void poll_pause(void) {
+#if defined(__aarch64__)
+    asm volatile("yield");
+#else
+    asm volatile("pause");
+#endif
+}
+
+static inline uint64_t poll_now(void) {
+    uint64_t now;
+
+    READ_COUNTER_BEFORE(now);
+    return now;
+}
+
+static inline void poll_init(struct poller *p, _Atomic(int) *mode) {
+    p->mode = mode;
+    p->budget = POLL_MIN_BUDGET;
+    p->gap = POLL_MAX_BUDGET;
+    p->last = poll_now();
+    p->deadline = 0;
+    p->backoff = 1;
+}
+
+static inline void poll_set_mode(struct poller *p, int mode) {
+    atomic_store(p->mode, mode);
+}
+
+/* the receiver got work: fold the arrival into the budget */
+static inline void poll_arrival(struct poller *p) {
+    uint64_t now = poll_now();
+    uint64_t delta = now - p->last;
+
+    p->last = now;
+    p->gap = p->gap - p->gap / 8 + delta / 8;
+    if (2 * p->gap <= POLL_MAX_BUDGET) {
+        p->budget = 2 * p->gap > POLL_MIN_BUDGET ? 2 * p->gap : POLL_MIN_BUDGET;
+    } else {
+        p->budget = POLL_MIN_BUDGET;
+    }
+    p->deadline = 0;
+    p->backoff = 1;
+}
+
+/*
+ * The receiver found its ring empty. Returns true after backing off if it
+ * should poll again, false if it should go to sleep.
+ */
+static inline bool poll_idle(struct poller *p) {
+    int mode = atomic_load_explicit(p->mode, memory_order_relaxed);
+    unsigned i;
+
+    if (mode == POLL_NOTIFY) {
+        return false;
+    }
+    if (mode == POLL_HYBRID) {
+        uint64_t now = poll_now();
+
+        if (p->deadline == 0) {
+            p->deadline = now + p->budget;
+        } else if (now >= p->deadline) {
+            p->deadline = 0;
+            p->backoff = 1;
+            return false;
+        }
+    }
+
+    for (i = 0; i < p->backoff; i++) {
+        poll_pause();
+    }
+    if (p->backoff < POLL_MAX_BACKOFF) {
+        p->backoff *= 2;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef __RECEIVER_H__
+#define __RECEIVER_H__
+
+#include "doorbell.h"
+
+#include "poll.h"
+#include "client.h"
+
+/*
+ * The receive loops of the two sides, shared by app.c, main.c and the host
+ * harness in tools/ring_host.c.
+ *
+ * receiver_echo() is app's: it answers every request on the request
+ * channel with a copy of it on the response channel. receiver_complete()
+ * is main's receiver thread's: it hands every response to
+ * client_complete().
+ *
+ * Both poll the ring as their poller says and then sleep on ntfn, the
+ * notification the ring's doorbell signals: a notification cap on seL4, a
+ * futex word on Linux (doorbell.h). A loop only returns if it was given a
+ * stop flag, once the flag is set and its ring is empty; whoever sets it
+ * must then signal ntfn. With RING_PMU, receiver_set_pmu() has a loop
+ * publish its thread's counters each time its ring runs empty.
+ */
+
+struct receiver {
+    struct transport *tp;  /* receiving end of the channel */
+    struct poller *poll;
+    doorbell_t ntfn;       /* notification the loop sleeps on */
+    _Atomic(int) *stop;    /* return once set, or NULL to run forever */
+#ifdef RING_PMU
+    struct pmu *pmu;             /* this thread's counters */
+    struct pmu_block *pmu_block; /* where to publish them, or NULL */
+#endif
+};
+
+static inline void receiver_init(struct receiver *r, struct transport *tp, struct poller *poll,
+                                 doorbell_t ntfn, _Atomic(int) *stop) {
+    r->tp = tp;
+    r->poll = poll;
+    r->ntfn = ntfn;
+    r->stop = stop;
+#ifdef RING_PMU
+    r->pmu = NULL;
+    r->pmu_block = NULL;
+#endif
+}
+
+#ifdef RING_PMU
+static inline void receiver_set_pmu(struct receiver *r, struct pmu *pmu,
+                                    struct pmu_block *pmu_block) {
+    r->pmu = pmu;
+    r->pmu_block = pmu_block;
+}
+#endif
+
+/* the ring ran empty: publish the counters, true if the loop should return */
+static inline bool receiver_drained(struct receiver *r) {
+#ifdef RING_PMU
+    if (r->pmu_block != NULL && r->pmu_block->taken != r->tp->taken) {
+        pmu_publish(r->pmu_block, r->pmu, r->tp->taken);
+    }
+#endif
+    return r->stop != NULL && atomic_load_explicit(r->stop, memory_order_relaxed);
+}
+
+/* sleep on the doorbell, the ring has been armed and found empty again */
+static inline void receiver_sleep(struct receiver *r) {
+    r->tp->aring->waits++;
+    STAT_INC(r->tp->stats, sleeps);
+    doorbell_wait(r->ntfn);
+    TRACE(r->tp->trace, TRACE_WAKE, TRACE_NO_SLOT, TRACE_DOORBELL);
+}
+
+#ifdef RING_INPLACE
+/* answer in the request slots and hand them back to main on the rsp aring */
+static inline void receiver_answer(struct receiver *r, struct transport *rsp,
+                                   const size_t *idx, size_t count) {
+    size_t i;
+
+    assert(count <= RING_BATCH);
+
+    /* the echo is the request itself, already where the response goes */
+    for (i = 0; i < count; i++) {
+        TRACE(r->tp->trace, TRACE_HANDLER, idx[i], req_slot(r->tp, idx[i])->word[0]);
+    }
+
+    rsp_post(rsp, idx, count);
+}
+
+/* main frees the slots once it has read the responses, so no credits are needed */
+static inline size_t receiver_take(struct receiver *r, struct transport *rsp, size_t *idx) {
+    return req_recv(r->tp, idx, RING_BATCH);
+}
+#else
+/* the caller holds at least count response credits */
+static inline void receiver_answer(struct receiver *r, struct transport *rsp,
+                                   const size_t *idx, size_t count) {
+    size_t i;
+    struct msg *req_msg, *slot;
+
+    assert(count <= RING_BATCH);
+
+    for (i = 0; i < count; i++) {
+        if (i + 1 < count) {
+            req_prefetch(r->tp, idx[i + 1]);
+        }
+        req_msg = req_slot(r->tp, idx[i]);
+        TRACE(r->tp->trace, TRACE_HANDLER, idx[i], req_msg->word[0]);
+        slot = rsp_next(rsp, i);
+        for (size_t w = 0; w < MSG_WORDS; w++) {
+            slot->word[w] = req_msg->word[w];
+        }
+    }
+
+    rsp_commit(rsp, count);
+    req_release(r->tp, idx, count);
+}
+
+/*
+ * Only take as many requests as there are response slots to answer them
+ * with, so that no request is held while waiting for main to drain its
+ * responses. Sleeps while main holds every response slot.
+ */
+static inline size_t receiver_take(struct receiver *r, struct transport *rsp, size_t *idx) {
+    size_t credits = rsp_credits(rsp);
+
+    if (credits == 0) {
+        rsp_reserve(rsp, 1);
+        credits = rsp->credits;
+    }
+
+    return req_recv(r->tp, idx, credits);
+}
+#endif
+
+/* app: echo every request on r's channel back as a response on rsp */
+static inline void receiver_echo(struct receiver *r, struct transport *rsp) {
+    size_t idx[RING_BATCH];
+    size_t n;
+
+again:
+    while ((n = receiver_take(r, rsp, idx)) != 0) {
+retry:
+        poll_arrival(r->poll);
+
+        receiver_answer(r, rsp, idx, n);
+    }
+    if (receiver_drained(r)) {
+        return;
+    }
+    if (poll_idle(r->poll)) {
+        goto again;
+    }
+    req_arm(r->tp);
+
+    n = receiver_take(r, rsp, idx);
+    if (n != 0) {
+        goto retry;
+    }
+
+    receiver_sleep(r);
+    goto again;
+}
+
+/* main: complete every response on r's channel with client c */
+static inline void receiver_complete(struct receiver *r, struct client *c) {
+    size_t idx[RING_BATCH];
+    size_t i, n;
+
+again:
+    while ((n = rsp_recv(r->tp, idx, RING_BATCH)) != 0) {
+retry:
+        poll_arrival(r->poll);
+
+        for (i = 0; i < n; i++) {
+            if (i + 1 < n) {
+                rsp_prefetch(r->tp, idx[i + 1]);
+            }
+            TRACE(r->tp->trace, TRACE_HANDLER, idx[i], rsp_slot(r->tp, idx[i])->word[0]);
+            client_complete(c, rsp_slot(r->tp, idx[i]));
+        }
+
+        rsp_release(r->tp, idx, n);
+    }
+    if (receiver_drained(r)) {
+        return;
+    }
+    if (poll_idle(r->poll)) {
+        goto again;
+    }
+    rsp_arm(r->tp);
+
+    n = rsp_recv(r->tp, idx, RING_BATCH);
+    if (n != 0) {
+        goto retry;
+    }
+
+    receiver_sleep(r);
+    goto again;
+}
+
+#endif
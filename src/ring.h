@@ -1,42 +1,325 @@
 #ifndef __RING_H__
 #define __RING_H__
 
+#include <assert.h>
+#include <stddef.h>
+
+#ifdef RING_STATS
+#define LFRING_STATS
+#endif
+
 #include "./include/lfring.h"
+#include "./include/spscring.h"
+#include "./include/lscq.h"
+#include "./include/wfring.h"
+#include "./include/inlring.h"
 
+#include "stats.h"
+#include "trace.h"
+#include "pmu.h"
+#include "poll.h"
+
+#ifndef RING_ORDER
 #define RING_ORDER   10
+#endif
+#ifndef BUFFER_ORDER
 #define BUFFER_ORDER 10
+#endif
 #define DATA_SLOT_SIZE 32
 
+/* maximum number of entries moved by one batched ring operation */
+#define RING_BATCH 32
+
+/*
+ * Data slots are DATA_SLOT_SIZE bytes but start SLOT_STRIDE bytes apart,
+ * per channel. Packed slots share cache lines, so a sender filling slot
+ * i + 1 takes the line from a receiver still reading slot i. With
+ * RING_SLOT_ISOLATE every slot gets LF_CACHE_BYTES of its own, the pair of
+ * lines adjacent-line prefetchers move together, at the cost of a larger
+ * buffer. -DREQ_SLOT_STRIDE and -DRSP_SLOT_STRIDE set one channel alone.
+ *
+ * Receivers prefetch the next received slot while handling one; build with
+ * -DRING_PREFETCH=0 to compare without.
+ */
+#ifdef RING_SLOT_ISOLATE
+#define SLOT_STRIDE LF_CACHE_BYTES
+#else
+#define SLOT_STRIDE DATA_SLOT_SIZE
+#endif
+#ifndef REQ_SLOT_STRIDE
+#define REQ_SLOT_STRIDE SLOT_STRIDE
+#endif
+#ifndef RSP_SLOT_STRIDE
+#define RSP_SLOT_STRIDE SLOT_STRIDE
+#endif
+#ifndef RING_PREFETCH
+#define RING_PREFETCH 1
+#endif
+
+/*
+ * ring algorithms: RING_SCQ allows any number of producers and consumers,
+ * RING_SPSC requires exactly one of each but needs no atomic
+ * read-modify-write operations, RING_LSCQ is an unbounded queue of
+ * RING_ORDER segments that takes any number of producers and one consumer,
+ * RING_WCQ is a wait-free SCQ for channels that need a bounded worst case
+ */
+#define RING_SCQ  0
+#define RING_SPSC 1
+#define RING_LSCQ 2
+#define RING_WCQ  3
+
+#define RING_TYPE_NAME(type) \
+        ((type) == RING_SPSC ? "spsc" : (type) == RING_LSCQ ? "lscq" : \
+         (type) == RING_WCQ ? "wcq" : "scq")
+
+/*
+ * each ring below has a single producer and a single consumer; the free
+ * rings hold every data slot, so only the arings may be RING_LSCQ
+ *
+ * A bounded aring must hold every data slot of its channel, however few
+ * are in flight at once. With -DARING_TYPE=RING_LSCQ an aring is instead a
+ * chain of RING_ORDER segments that grows from its pool under a burst and
+ * shrinks again once it is drained, so RING_ORDER can be sized for the
+ * usual load: -DARING_TYPE=RING_LSCQ -DRING_ORDER=6 gives each aring one
+ * 64-entry segment where the default needs 1024 entries.
+ */
+#ifndef ARING_TYPE
+#define ARING_TYPE RING_SPSC
+#endif
+
+#define REQ_FRING_TYPE RING_SPSC
+#define RSP_FRING_TYPE RING_SPSC
+#define REQ_ARING_TYPE ARING_TYPE
+#define RSP_ARING_TYPE ARING_TYPE
+
 #define PAGE_SIZE 4096
 
+/*
+ * The shared region is mapped MAP_BITS at a time. With RING_LARGE_PAGES
+ * that is a large page (seL4_LargePageBits, which main.c checks against
+ * LARGE_PAGE_BITS), and every region below starts on a large page
+ * boundary unless it fits in what is left of the current large page, so
+ * no ring or buffer spans more TLB entries than its size needs.
+ */
+#ifdef RING_LARGE_PAGES
+#ifndef LARGE_PAGE_BITS
+#define LARGE_PAGE_BITS 21
+#endif
+#define MAP_BITS     LARGE_PAGE_BITS
+#define RING_PAGING  "large"
+#else
+#define MAP_BITS     12
+#define RING_PAGING  "small"
+#endif
+#define MAP_PAGES    ((1UL << MAP_BITS) / PAGE_SIZE)
+
 #define RING_SIZE    (1U << RING_ORDER)
 #define BUFFER_SIZE  (1U << BUFFER_ORDER)
-#define RING_PAGES ((LFRING_SIZE(RING_ORDER) + PAGE_SIZE - 1) / PAGE_SIZE)
-#define BUFFER_PAGES   ((DATA_SLOT_SIZE * BUFFER_SIZE + PAGE_SIZE - 1) / PAGE_SIZE)
+#define FRING_ORDER  BUFFER_ORDER
+#define ARING_ORDER  RING_ORDER
+
+/*
+ * Each channel can be sized for its own traffic; both default to
+ * RING_ORDER and BUFFER_ORDER. The free ring of a channel holds its data
+ * slots, so its order is the buffer order. The layout header (layout.h)
+ * records what a build uses.
+ */
+#ifndef REQ_RING_ORDER
+#define REQ_RING_ORDER   RING_ORDER
+#endif
+#ifndef REQ_BUFFER_ORDER
+#define REQ_BUFFER_ORDER BUFFER_ORDER
+#endif
+#ifndef RSP_RING_ORDER
+#define RSP_RING_ORDER   RING_ORDER
+#endif
+#ifndef RSP_BUFFER_ORDER
+#define RSP_BUFFER_ORDER BUFFER_ORDER
+#endif
+#define REQ_BUFFER_SIZE  (1U << REQ_BUFFER_ORDER)
+#define RSP_BUFFER_SIZE  (1U << RSP_BUFFER_ORDER)
+
+/*
+ * LSCQ segments come from a pool carved out of the aring itself, big
+ * enough for every data slot of its channel to sit in the aring at once;
+ * both arings get the pool the larger of them needs
+ */
+#define LSCQ_CHANNEL_POOL_ORDER(border, rorder) \
+        ((border) - (rorder) + 1 > LFRING_MIN ? (border) - (rorder) + 1 : LFRING_MIN)
+#define LSCQ_REQ_POOL_ORDER LSCQ_CHANNEL_POOL_ORDER(REQ_BUFFER_ORDER, REQ_RING_ORDER)
+#define LSCQ_RSP_POOL_ORDER LSCQ_CHANNEL_POOL_ORDER(RSP_BUFFER_ORDER, RSP_RING_ORDER)
+#define LSCQ_POOL_ORDER \
+        (LSCQ_REQ_POOL_ORDER > LSCQ_RSP_POOL_ORDER ? LSCQ_REQ_POOL_ORDER : LSCQ_RSP_POOL_ORDER)
+
+/*
+ * a wCQ ring keeps a record per thread that may use it; these rings have
+ * one producer and one consumer
+ */
+#define RING_WCQ_THREADS  2
+#define RING_WCQ_PRODUCER 0
+#define RING_WCQ_CONSUMER 1
+
+/* segments are linked by pointer, so both sides must map them at one address */
+#define RING_SHARED_POINTERS (REQ_ARING_TYPE == RING_LSCQ || RSP_ARING_TYPE == RING_LSCQ)
+
+#define RING_BYTES(type, order) \
+        ((type) == RING_LSCQ ? LSCQ_SIZE(order, LSCQ_POOL_ORDER) : \
+         (type) == RING_WCQ ? WFRING_SIZE(order, RING_WCQ_THREADS) : LFRING_SIZE(order))
+#define RING_PAGES(type, order) \
+        ((offsetof(struct aring, ring) + RING_BYTES(type, order) + PAGE_SIZE - 1) / PAGE_SIZE)
+#define BUFFER_PAGES(stride, order) ((((size_t)(stride) << (order)) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+/*
+ * With RING_INLINE the arings carry messages of INLINE_WORDS words in
+ * their entries (inlring.h) instead of the indices of data slots, so a
+ * message costs one enqueue and one dequeue and there are no free rings or
+ * data buffers at all; struct msg shrinks to MSG_WORDS = INLINE_WORDS. An
+ * inline aring holds as many messages as its channel has data slots
+ * otherwise. Larger payloads need the default build.
+ */
+#ifdef RING_INLINE
+#ifndef INLINE_WORDS
+#define INLINE_WORDS 2
+#endif
+#if INLINE_WORDS != 2 && INLINE_WORDS != 4
+#error "INLINE_WORDS must be 2 (an id and a word) or 4 (a whole default slot)"
+#endif
+#define INLINE_ORDER(border) ((border) + (INLINE_WORDS == 2 ? 1 : 2))
+#define REQ_INLINE_ORDER INLINE_ORDER(REQ_BUFFER_ORDER)
+#define RSP_INLINE_ORDER INLINE_ORDER(RSP_BUFFER_ORDER)
+#define MSG_WORDS      INLINE_WORDS
+#define FRING_NAME(type) "none"
+#define ARING_NAME(type) "inline"
+#define REQ_FRING_PAGES  0
+#define REQ_DATA_PAGES   0
+#define INLINE_PAGES(order) \
+        ((offsetof(struct aring, ring) + INLRING_SIZE(order) + PAGE_SIZE - 1) / PAGE_SIZE)
+#define REQ_ARING_PAGES  INLINE_PAGES(REQ_INLINE_ORDER)
+#define RSP_ARING_PAGES  INLINE_PAGES(RSP_INLINE_ORDER)
+#else
+#define MSG_WORDS      (DATA_SLOT_SIZE / sizeof(unsigned long))
+#define FRING_NAME(type) RING_TYPE_NAME(type)
+#define ARING_NAME(type) RING_TYPE_NAME(type)
+#define REQ_FRING_PAGES  RING_PAGES(REQ_FRING_TYPE, REQ_BUFFER_ORDER)
+#define REQ_DATA_PAGES   BUFFER_PAGES(REQ_SLOT_STRIDE, REQ_BUFFER_ORDER)
+#define REQ_ARING_PAGES  RING_PAGES(REQ_ARING_TYPE, REQ_RING_ORDER)
+#define RSP_ARING_PAGES  RING_PAGES(RSP_ARING_TYPE, RSP_RING_ORDER)
+#endif
+
+/*
+ * With RING_INPLACE app answers a request in the request's own slot and
+ * posts that index on the rsp aring, and main's receiver thread returns it
+ * to the request free ring once the response has been read. The response
+ * free ring and data buffer are not needed then, and RSP_FRING() and
+ * RSP_DATA_BUF() name the request ones.
+ */
+#if defined(RING_INPLACE) && defined(RING_INLINE)
+#error "RING_INPLACE needs data slots, which RING_INLINE does away with"
+#endif
+
+#if defined(RING_INPLACE) || defined(RING_INLINE)
+#define RSP_FRING_PAGES 0
+#define RSP_DATA_PAGES  0
+#else
+#define RSP_FRING_PAGES RING_PAGES(RSP_FRING_TYPE, RSP_BUFFER_ORDER)
+#define RSP_DATA_PAGES  BUFFER_PAGES(RSP_SLOT_STRIDE, RSP_BUFFER_ORDER)
+#endif
+
+#ifdef RING_INPLACE
+#define RING_REPLIES    "inplace"
+#else
+#define RING_REPLIES    "copy"
+#endif
+
+#define LAYOUT_PAGES   1
+
+#ifdef RING_STATS
+#define STATS_PAGES    ((sizeof(struct stats_page) + PAGE_SIZE - 1) / PAGE_SIZE)
+#else
+#define STATS_PAGES    0
+#endif
+
+#ifdef RING_TRACE
+#define TRACE_PAGES    ((sizeof(struct trace_area) + PAGE_SIZE - 1) / PAGE_SIZE)
+#else
+#define TRACE_PAGES    0
+#endif
+
+#ifdef RING_PMU
+#define PMU_PAGES      ((sizeof(struct pmu_block) + PAGE_SIZE - 1) / PAGE_SIZE)
+#else
+#define PMU_PAGES      0
+#endif
 
-#define SHARED_PAGES (4*RING_PAGES + 2*BUFFER_PAGES)
+/* the layout header, see layout.h */
+#define LAYOUT(shared_mem) \
+        ((struct layout *) ((char *) shared_mem + LAYOUT_PAGE * PAGE_SIZE))
 
 /* ring buffer structures */
+#ifdef RING_INLINE
+#define REQ_FRING(shared_mem)       ((struct fring *) NULL)
+#else
 #define REQ_FRING(shared_mem)       \
-        ((struct fring *) ((char *) shared_mem + 0 * RING_PAGES * PAGE_SIZE))
+        ((struct fring *) ((char *) shared_mem + REQ_FRING_PAGE * PAGE_SIZE))
+#endif
 
+#if defined(RING_INPLACE) || defined(RING_INLINE)
+#define RSP_FRING(shared_mem)       REQ_FRING(shared_mem)
+#else
 #define RSP_FRING(shared_mem)       \
-        ((struct fring *) ((char *) shared_mem + 1 * RING_PAGES * PAGE_SIZE))
+        ((struct fring *) ((char *) shared_mem + RSP_FRING_PAGE * PAGE_SIZE))
+#endif
 
 #define REQ_ARING(shared_mem)       \
-        ((struct aring *) ((char *) shared_mem + 2 * RING_PAGES * PAGE_SIZE))
+        ((struct aring *) ((char *) shared_mem + REQ_ARING_PAGE * PAGE_SIZE))
 
 #define RSP_ARING(shared_mem)   \
-        ((struct aring *) ((char *) shared_mem + 3 * RING_PAGES * PAGE_SIZE))
+        ((struct aring *) ((char *) shared_mem + RSP_ARING_PAGE * PAGE_SIZE))
 
+#ifdef RING_INLINE
+#define REQ_DATA_BUF(shared_mem) NULL
+#else
 #define REQ_DATA_BUF(shared_mem) \
-        ((char *) shared_mem + 4 * RING_PAGES * PAGE_SIZE)
+        ((char *) shared_mem + REQ_DATA_PAGE * PAGE_SIZE)
+#endif
 
+#if defined(RING_INPLACE) || defined(RING_INLINE)
+#define RSP_DATA_BUF(shared_mem) REQ_DATA_BUF(shared_mem)
+#else
 #define RSP_DATA_BUF(shared_mem) \
-        ((char *) shared_mem + (4 * RING_PAGES + BUFFER_PAGES) * PAGE_SIZE)
+        ((char *) shared_mem + RSP_DATA_PAGE * PAGE_SIZE)
+#endif
+
+#define STATS(shared_mem) \
+        ((struct stats_page *) ((char *) shared_mem + STATS_PAGE * PAGE_SIZE))
+
+#define TRACE_AREA(shared_mem) \
+        ((struct trace_area *) ((char *) shared_mem + TRACE_PAGE * PAGE_SIZE))
+
+#define PMU_BLOCK(shared_mem) \
+        ((struct pmu_block *) ((char *) shared_mem + PMU_PAGE * PAGE_SIZE))
+
+/* one message as laid out in a data buffer slot */
+struct msg {
+    unsigned long word[MSG_WORDS];
+};
 
+/*
+ * An aring's doorbell is suppressed with an event index, as in virtio: the
+ * receiver publishes in event the count of entries it had taken when it
+ * went to sleep, and a sender only signals if its post moves posted past
+ * that point. While the receiver is awake, event is left behind and no
+ * post crosses it.
+ */
 struct aring {
-    _Alignas(LF_CACHE_BYTES) _Atomic(long) readers;
+    /* written by the receiver */
+    _Alignas(LF_CACHE_BYTES) _Atomic(unsigned long) event;
+    _Atomic(int) poll_mode; /* how the receiver waits, see poll.h */
+    unsigned long waits;    /* times the receiver slept, i.e. signals needed */
+    /* written by the sender */
+    _Alignas(LF_CACHE_BYTES) _Atomic(unsigned long) posted; /* entries ever posted */
+    unsigned long signals;  /* signals sent */
+    _Atomic(int) full;      /* RING_INLINE: set while the sender sleeps for room */
     _Alignas(LFRING_ALIGN) char ring[0];
 };
 
@@ -45,4 +328,224 @@ struct fring {
     _Alignas(LFRING_ALIGN) char ring[0];
 };
 
+_Static_assert(WFRING_ALIGN <= LFRING_ALIGN, "wfring must fit wherever an lfring does");
+_Static_assert(REQ_FRING_TYPE != RING_LSCQ && RSP_FRING_TYPE != RING_LSCQ,
+               "free rings must be bounded");
+_Static_assert((1U << LSCQ_POOL_ORDER) >= (1U << REQ_BUFFER_ORDER >> REQ_RING_ORDER) + 2 &&
+               (1U << LSCQ_POOL_ORDER) >= (1U << RSP_BUFFER_ORDER >> RSP_RING_ORDER) + 2,
+               "LSCQ pool too small for every data slot");
+#ifdef RING_INPLACE
+_Static_assert(REQ_FRING_TYPE == RSP_FRING_TYPE && REQ_SLOT_STRIDE == RSP_SLOT_STRIDE &&
+               REQ_BUFFER_ORDER == RSP_BUFFER_ORDER,
+               "in-place replies return request slots through the rsp channel");
+#endif
+
+/* where a region of pages pages goes at or after page, see MAP_BITS */
+#define MAP_FIT(page, pages) \
+        ((page) % MAP_PAGES + (pages) <= MAP_PAGES || (page) % MAP_PAGES == 0 ? \
+         (page) : ((page) / MAP_PAGES + 1) * MAP_PAGES)
+
+/* page offsets of the regions in shared memory, enumerators so each is folded once */
+enum {
+    LAYOUT_PAGE    = 0,
+    REQ_FRING_PAGE = MAP_FIT(LAYOUT_PAGE + LAYOUT_PAGES, REQ_FRING_PAGES),
+    RSP_FRING_PAGE = MAP_FIT(REQ_FRING_PAGE + REQ_FRING_PAGES, RSP_FRING_PAGES),
+    REQ_ARING_PAGE = MAP_FIT(RSP_FRING_PAGE + RSP_FRING_PAGES, REQ_ARING_PAGES),
+    RSP_ARING_PAGE = MAP_FIT(REQ_ARING_PAGE + REQ_ARING_PAGES, RSP_ARING_PAGES),
+    REQ_DATA_PAGE  = MAP_FIT(RSP_ARING_PAGE + RSP_ARING_PAGES, REQ_DATA_PAGES),
+    RSP_DATA_PAGE  = MAP_FIT(REQ_DATA_PAGE + REQ_DATA_PAGES, RSP_DATA_PAGES),
+    STATS_PAGE     = MAP_FIT(RSP_DATA_PAGE + RSP_DATA_PAGES, STATS_PAGES),
+    TRACE_PAGE     = MAP_FIT(STATS_PAGE + STATS_PAGES, TRACE_PAGES),
+    PMU_PAGE       = MAP_FIT(TRACE_PAGE + TRACE_PAGES, PMU_PAGES),
+    SHARED_END     = PMU_PAGE + PMU_PAGES,
+};
+
+/* the region is a whole number of mappings */
+#define SHARED_PAGES ((SHARED_END + MAP_PAGES - 1) / MAP_PAGES * MAP_PAGES)
+#define SHARED_MAPS  (SHARED_PAGES / MAP_PAGES)
+
+/*
+ * Order a preceding enqueue before the readers check that decides whether
+ * to signal; SCQ, LSCQ and wCQ get this from their read-modify-write operations
+ * already.
+ */
+static inline void ring_doorbell_fence(int type) {
+    if (type == RING_SPSC) {
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+}
+
+static inline void ring_init_empty(int type, char *ring, size_t order) {
+    if (type == RING_LSCQ) {
+        lscq_init((struct lscq *)ring, order, LSCQ_POOL_ORDER);
+    } else if (type == RING_WCQ) {
+        wfring_init_empty((struct wfring *)ring, order, RING_WCQ_THREADS);
+    } else if (type == RING_SPSC) {
+        spscring_init_empty((struct spscring *)ring, order);
+    } else {
+        lfring_init_empty((struct lfring *)ring, order);
+    }
+}
+
+static inline void ring_init_fill(int type, char *ring, size_t s, size_t e, size_t order) {
+    if (type == RING_SPSC) {
+        spscring_init_fill((struct spscring *)ring, s, e, order);
+    } else if (type == RING_WCQ) {
+        wfring_init_fill((struct wfring *)ring, s, e, order, RING_WCQ_THREADS);
+    } else {
+        lfring_init_fill((struct lfring *)ring, s, e, order);
+    }
+}
+
+/*
+ * The batched operations of each ring type; stats may be NULL, and is
+ * ignored without RING_STATS. The bounded rings are never full:
+ * CHANNEL_DEFINE asserts that each holds every index of its channel.
+ */
+static inline size_t ring_count_batch(struct ring_stats *stats, size_t n) {
+    if (n != 0) {
+        STAT_INC(stats, ok);
+    } else {
+        STAT_INC(stats, empty);
+    }
+    return n;
+}
+
+static inline void ring_scq_enqueue_batch(char *ring, size_t order, const size_t *eidx,
+                                          size_t count, struct ring_stats *stats) {
+    lfring_enqueue_batch((struct lfring *)ring, order, eidx, count, false, STAT_LF(stats));
+}
+
+static inline size_t ring_scq_dequeue_batch(char *ring, size_t order, size_t *eidx,
+                                            size_t count, struct ring_stats *stats) {
+    return ring_count_batch(stats, lfring_dequeue_batch((struct lfring *)ring, order, eidx,
+                                                        count, false, STAT_LF(stats)));
+}
+
+static inline void ring_spsc_enqueue_batch(char *ring, size_t order, const size_t *eidx,
+                                           size_t count, struct ring_stats *stats) {
+    bool ok = spscring_enqueue_batch((struct spscring *)ring, order, eidx, count,
+                                     STAT_SPSC(stats));
+
+    assert(ok);
+    (void)ok;
+}
+
+static inline size_t ring_spsc_dequeue_batch(char *ring, size_t order, size_t *eidx,
+                                             size_t count, struct ring_stats *stats) {
+    return ring_count_batch(stats, spscring_dequeue_batch((struct spscring *)ring, order,
+                                                          eidx, count, STAT_SPSC(stats)));
+}
+
+/*
+ * The LSCQ pool is sized so that an enqueue only fails while the consumer
+ * has yet to hand back a drained segment; back off between attempts as
+ * an idle poller does (poll.h) rather than hammer the queue's tail.
+ */
+static inline void ring_lscq_enqueue_batch(char *ring, size_t order, const size_t *eidx,
+                                           size_t count, struct ring_stats *stats) {
+    unsigned backoff, k;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        backoff = 1;
+        while (!lscq_enqueue((struct lscq *)ring, order, LSCQ_POOL_ORDER, eidx[i])) {
+            for (k = 0; k < backoff; k++) {
+                poll_pause();
+            }
+            if (backoff < POLL_MAX_BACKOFF) {
+                backoff *= 2;
+            }
+        }
+    }
+}
+
+static inline size_t ring_lscq_dequeue_batch(char *ring, size_t order, size_t *eidx,
+                                             size_t count, struct ring_stats *stats) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        eidx[i] = lscq_dequeue((struct lscq *)ring, order, LSCQ_POOL_ORDER);
+        if (eidx[i] == LFRING_EMPTY) {
+            break;
+        }
+    }
+    return ring_count_batch(stats, i);
+}
+
+static inline void ring_wcq_enqueue_batch(char *ring, size_t order, const size_t *eidx,
+                                          size_t count, struct ring_stats *stats) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        wfring_enqueue((struct wfring *)ring, order, eidx[i], false, RING_WCQ_PRODUCER);
+    }
+}
+
+static inline size_t ring_wcq_dequeue_batch(char *ring, size_t order, size_t *eidx,
+                                            size_t count, struct ring_stats *stats) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        eidx[i] = wfring_dequeue((struct wfring *)ring, order, false, RING_WCQ_CONSUMER);
+        if (eidx[i] == LFRING_EMPTY) {
+            break;
+        }
+    }
+    return ring_count_batch(stats, i);
+}
+
+/*
+ * RING_CHOOSE(type, op) is the ring_<type>_<op> function of a ring type
+ * given as a constant expression. The compiler makes the choice, so no
+ * test of the type is left in the caller; a type only known at run time
+ * does not compile.
+ */
+#define RING_CHOOSE(type, op) \
+        __builtin_choose_expr((type) == RING_SPSC, ring_spsc_##op, \
+        __builtin_choose_expr((type) == RING_LSCQ, ring_lscq_##op, \
+        __builtin_choose_expr((type) == RING_WCQ, ring_wcq_##op, ring_scq_##op)))
+
+/* the same for a type only known at run time, as in main.c's ring benchmark */
+static inline void ring_enqueue_batch(int type, char *ring, size_t order,
+                                      const size_t *eidx, size_t count, struct ring_stats *stats) {
+    if (type == RING_LSCQ) {
+        ring_lscq_enqueue_batch(ring, order, eidx, count, stats);
+    } else if (type == RING_SPSC) {
+        ring_spsc_enqueue_batch(ring, order, eidx, count, stats);
+    } else if (type == RING_WCQ) {
+        ring_wcq_enqueue_batch(ring, order, eidx, count, stats);
+    } else {
+        ring_scq_enqueue_batch(ring, order, eidx, count, stats);
+    }
+}
+
+static inline size_t ring_dequeue_batch(int type, char *ring, size_t order,
+                                        size_t *eidx, size_t count, struct ring_stats *stats) {
+    if (type == RING_LSCQ) {
+        return ring_lscq_dequeue_batch(ring, order, eidx, count, stats);
+    }
+    if (type == RING_SPSC) {
+        return ring_spsc_dequeue_batch(ring, order, eidx, count, stats);
+    }
+    if (type == RING_WCQ) {
+        return ring_wcq_dequeue_batch(ring, order, eidx, count, stats);
+    }
+    return ring_scq_dequeue_batch(ring, order, eidx, count, stats);
+}
+
+#include "channel.h"
+
+#ifdef RING_INLINE
+INLINE_CHANNEL_DEFINE(req_chan, INLINE_WORDS, REQ_INLINE_ORDER)
+INLINE_CHANNEL_DEFINE(rsp_chan, INLINE_WORDS, RSP_INLINE_ORDER)
+#else
+CHANNEL_DEFINE(req_chan, struct msg, REQ_SLOT_STRIDE, REQ_BUFFER_ORDER, REQ_RING_ORDER,
+               REQ_FRING_TYPE, REQ_ARING_TYPE)
+CHANNEL_DEFINE(rsp_chan, struct msg, RSP_SLOT_STRIDE, RSP_BUFFER_ORDER, RSP_RING_ORDER,
+               RSP_FRING_TYPE, RSP_ARING_TYPE)
+#endif
+
+#include "layout.h"
+
 #endif
@@ -0,0 +1,91 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+
+/*
+ * Ring and transport counters, compiled in with RING_STATS.
+ *
+ * Every end of a channel gets a struct transport_stats block on the stats
+ * page, which sits at the end of the shared region so that main and app
+ * can both read all four blocks while traffic runs. Only the thread that
+ * owns an end writes its block, and each block has cache lines of its own,
+ * so counting never moves a line between cores; readers see values that
+ * may be a little stale. Without RING_STATS the stats page, the pointers to
+ * it and every STAT_INC() compile to nothing.
+ */
+
+#ifdef RING_STATS
+
+/*
+ * One ring as seen from one end of a channel. Besides ok and empty, SCQ
+ * rings count their CAS retries, catchups and exhausted dequeues, and SPSC
+ * rings how often a side had to reload the other side's index (spscring.h).
+ * LSCQ and wCQ rings only count ok and empty.
+ */
+struct ring_stats {
+    unsigned long ok;           /* batched dequeues that got entries */
+    unsigned long empty;        /* batched dequeues that got none */
+    struct lfring_stats lf;     /* SCQ internals, zero for other ring types */
+    struct spscring_stats spsc; /* SPSC internals, zero for other ring types */
+};
+
+struct transport_stats {
+    _Alignas(LF_CACHE_BYTES) struct ring_stats fring;
+    struct ring_stats aring;
+    unsigned long spins;         /* reserve attempts short of credits */
+    unsigned long credit_sleeps; /* sleeps waiting for credits */
+    unsigned long signals;       /* doorbells and credit signals sent */
+    unsigned long sleeps;        /* sleeps on the doorbell */
+};
+
+struct stats_page {
+    struct transport_stats req_send; /* main */
+    struct transport_stats req_recv; /* app */
+    struct transport_stats rsp_send; /* app */
+    struct transport_stats rsp_recv; /* main's receiver thread */
+};
+
+#define STAT_INC(stats, field) ((stats) != NULL ? (void)(stats)->field++ : (void)0)
+#define STAT_RING(stats, ring) ((stats) != NULL ? &(stats)->ring : NULL)
+#define STAT_LF(stats)         ((stats) != NULL ? &(stats)->lf : NULL)
+#define STAT_SPSC(stats)       ((stats) != NULL ? &(stats)->spsc : NULL)
+
+static inline void stats_init(struct stats_page *page) {
+    char *p = (char *)page;
+
+    for (size_t i = 0; i < sizeof(*page); i++) {
+        p[i] = 0;
+    }
+}
+
+static inline void stats_print_end(const char *name, const struct transport_stats *s) {
+    printf("stats %s: fring ok %lu empty %lu retries %lu catchups %lu exhausted %lu "
+           "refreshes %lu, aring ok %lu empty %lu retries %lu catchups %lu exhausted %lu "
+           "refreshes %lu, spins %lu credit sleeps %lu signals %lu sleeps %lu\n", name,
+        s->fring.ok, s->fring.empty, s->fring.lf.retries, s->fring.lf.catchups,
+        s->fring.lf.exhausted, s->fring.spsc.refreshes, s->aring.ok, s->aring.empty,
+        s->aring.lf.retries, s->aring.lf.catchups, s->aring.lf.exhausted,
+        s->aring.spsc.refreshes, s->spins, s->credit_sleeps, s->signals, s->sleeps);
+}
+
+static inline void stats_print(const struct stats_page *page) {
+    stats_print_end("req_send", &page->req_send);
+    stats_print_end("req_recv", &page->req_recv);
+    stats_print_end("rsp_send", &page->rsp_send);
+    stats_print_end("rsp_recv", &page->rsp_recv);
+}
+
+#else
+
+struct ring_stats;
+struct transport_stats;
+
+#define STAT_INC(stats, field) ((void)0)
+#define STAT_RING(stats, ring) NULL
+#define STAT_LF(stats)         NULL
+#define STAT_SPSC(stats)       NULL
+
+#endif
+
+#endif
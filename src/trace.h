@@ -0,0 +1,144 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "counter.h"
+
+/*
+ * Event tracing of the message path, compiled in with RING_TRACE.
+ *
+ * Every end of a channel has a struct trace_buf at the end of the shared
+ * region, and only the thread owning that end writes to it. A
+ * record is a counter timestamp, an event, the data slot it concerns and
+ * an argument, 24 bytes in all. The buffer keeps the last TRACE_ENTRIES
+ * records; the writer fills a record and then publishes it by advancing
+ * head, so recording takes no locks and readers may look at any time.
+ *
+ *   TRACE_ALLOC    the sender took slot as a credit
+ *   TRACE_ENQUEUE  the sender posted slot to the aring
+ *   TRACE_SIGNAL   the thread signalled, arg is TRACE_DOORBELL when a sender
+ *                  rang the doorbell or TRACE_CREDIT when a receiver woke a
+ *                  sender waiting for credits
+ *   TRACE_WAKE     the thread woke from a sleep, arg as for TRACE_SIGNAL
+ *   TRACE_DEQUEUE  the receiver took slot from the aring
+ *   TRACE_HANDLER  the receiver handled slot, arg is the request id
+ *   TRACE_FREE     the receiver returned slot to the free ring
+ *
+ * Events that concern no one slot have slot TRACE_NO_SLOT. Slots are kept
+ * modulo 2^31 so that they never run into it.
+ *
+ * trace_dump() prints every record as
+ *
+ *   trace <end> <time> <event> <slot> <arg>
+ *
+ * for tools/trace_timeline.py, which rebuilds the timeline of each request.
+ * Without RING_TRACE the buffers, the pointers to them and every TRACE()
+ * compile to nothing.
+ */
+
+#define TRACE_ALLOC   1
+#define TRACE_ENQUEUE 2
+#define TRACE_SIGNAL  3
+#define TRACE_WAKE    4
+#define TRACE_DEQUEUE 5
+#define TRACE_HANDLER 6
+#define TRACE_FREE    7
+
+#define TRACE_NO_SLOT   UINT32_MAX
+#define TRACE_SLOT_MASK 0x7fffffffU
+
+#define TRACE_DOORBELL 0
+#define TRACE_CREDIT   1
+
+#ifdef RING_TRACE
+
+#ifndef TRACE_ORDER
+#define TRACE_ORDER 12
+#endif
+#define TRACE_ENTRIES (1UL << TRACE_ORDER)
+
+struct trace_rec {
+    uint64_t time;
+    uint32_t event;
+    uint32_t slot;
+    uint64_t arg;
+};
+
+struct trace_buf {
+    _Alignas(LF_CACHE_BYTES) _Atomic(unsigned long) head; /* records ever written */
+    struct trace_rec rec[TRACE_ENTRIES];
+};
+
+struct trace_area {
+    struct trace_buf req_send; /* main */
+    struct trace_buf req_recv; /* app */
+    struct trace_buf rsp_send; /* app */
+    struct trace_buf rsp_recv; /* main's receiver thread */
+};
+
+static inline void trace_record(struct trace_buf *b, unsigned event, size_t slot,
+                                unsigned long arg) {
+    unsigned long head;
+    struct trace_rec *rec;
+
+    if (b == NULL) {
+        return;
+    }
+    head = atomic_load_explicit(&b->head, memory_order_relaxed);
+    rec = &b->rec[head & (TRACE_ENTRIES - 1)];
+    rec->time = counter_start();
+    rec->event = event;
+    rec->slot = slot == TRACE_NO_SLOT ? TRACE_NO_SLOT : slot & TRACE_SLOT_MASK;
+    rec->arg = arg;
+    atomic_store_explicit(&b->head, head + 1, memory_order_release);
+}
+
+#define TRACE(b, event, slot, arg) trace_record((b), (event), (slot), (arg))
+
+#define TRACE_SLOTS(b, event, idx, count) do {                                      \
+    for (size_t __i = 0; __i < (count); __i++) {                                    \
+        trace_record((b), (event), (idx)[__i], 0);                                  \
+    }                                                                               \
+} while (0)
+
+static inline void trace_init(struct trace_area *area) {
+    atomic_init(&area->req_send.head, 0);
+    atomic_init(&area->req_recv.head, 0);
+    atomic_init(&area->rsp_send.head, 0);
+    atomic_init(&area->rsp_recv.head, 0);
+}
+
+/* print the records still held, oldest first; best run once traffic stops */
+static inline void trace_dump_buf(const char *name, struct trace_buf *b) {
+    unsigned long head = atomic_load_explicit(&b->head, memory_order_acquire);
+    unsigned long i = head > TRACE_ENTRIES ? head - TRACE_ENTRIES : 0;
+
+    for (; i < head; i++) {
+        const struct trace_rec *rec = &b->rec[i & (TRACE_ENTRIES - 1)];
+
+        printf("trace %s %lu %u %u %lu\n", name, (unsigned long)rec->time,
+            (unsigned)rec->event, (unsigned)rec->slot, (unsigned long)rec->arg);
+    }
+}
+
+static inline void trace_dump(struct trace_area *area) {
+    printf("trace_hz %lu\n", (unsigned long)counter_calibration()->hz);
+    trace_dump_buf("req_send", &area->req_send);
+    trace_dump_buf("req_recv", &area->req_recv);
+    trace_dump_buf("rsp_send", &area->rsp_send);
+    trace_dump_buf("rsp_recv", &area->rsp_recv);
+}
+
+#else
+
+struct trace_buf;
+struct trace_area;
+
+#define TRACE(b, event, slot, arg)        ((void)0)
+#define TRACE_SLOTS(b, event, idx, count) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include "doorbell.h"
+
+/*
+ * Flow-controlled messaging on top of the channels in ring.h.
+ *
+ * Every free data slot is a credit. A sender takes credits from its free
+ * ring up to RING_BATCH at a time and holds them in its struct transport,
+ * so it touches the free ring once per batch and always knows how many
+ * messages it can send without waiting. The receiver returns the slots
+ * with name_release(), which wakes the sender if it has gone to sleep on
+ * credit_ntfn for lack of credits. The free ring's readers flag is -1
+ * while its sender sleeps. The aring doorbell uses the event index of
+ * struct aring instead: a receiver about to sleep calls name_arm() and
+ * checks the ring once more, and name_commit() only signals if it posts the
+ * entry the receiver is waiting for.
+ *
+ * TRANSPORT_DEFINE(name, chan, slot_t) generates, for one direction:
+ *
+ *   name_try_reserve(t, count)   hold count credits, or TRANSPORT_WOULD_BLOCK
+ *   name_reserve(t, count)       hold count credits, sleeping until they are freed
+ *   name_credits(t)              credits held after topping up without waiting
+ *   name_next(t, i)              slot of the i-th message of the next commit
+ *   name_commit(t, count)        publish the next count slots, ring the doorbell
+ *   name_post(t, idx, count)     publish slots not held as credits, as name_commit
+ *   name_try_send(t, msg, count) copy in and commit, or TRANSPORT_WOULD_BLOCK
+ *   name_send(t, msg, count)     copy in and commit, sleeping for credits
+ *   name_recv(t, idx, count)     take up to count published slots
+ *   name_slot(t, idx)            address of a received slot
+ *   name_prefetch(t, idx)        start loading a received slot to be read soon
+ *   name_release(t, idx, count)  return received slots as credits
+ *   name_arm(t)                  ask to be signalled by the next post
+ *
+ * name_post() is for slots the caller owns some other way, such as the
+ * request slots app answers in place with RING_INPLACE (see ring.h); the
+ * receiver's name_release() then returns them to the fring they came from.
+ *
+ * With RING_STATS, transport_set_stats() points an end at its block on the
+ * stats page, and the calls above count into it. With RING_TRACE,
+ * transport_set_trace() gives an end its trace buffer, and the calls above
+ * record the alloc, enqueue, signal, dequeue and free of every slot.
+ *
+ * With RING_INLINE (see ring.h) messages travel in the aring entries and
+ * there are no slots to hold as credits. A credit is room for a message in
+ * the aring instead, which name_try_reserve() reads off the ring's head, so
+ * no caller has to bound what it sends some other way. name_next() points
+ * into a staging array of the struct transport that name_commit() copies
+ * into the aring, and name_recv() copies the messages out into another,
+ * where name_slot() finds them until the next name_recv(). The idx of a
+ * received message is its position in the channel, which is also what
+ * traces record as its slot. A sender out of room sleeps with the aring's
+ * full flag set, and name_release() wakes it; there is no name_post().
+ */
+
+#define TRANSPORT_OK          0
+#define TRANSPORT_WOULD_BLOCK 1
+
+struct transport {
+    struct fring *fring;
+    struct aring *aring;
+    void *data_buf;
+    doorbell_t doorbell;    /* signalled when the receiver sleeps on the aring */
+    doorbell_t credit_ntfn; /* notification for returned credits */
+    size_t credits;         /* number of slots held in credit[] */
+    unsigned long taken;    /* entries received from the aring */
+#ifdef RING_STATS
+    struct transport_stats *stats; /* this end's counters, or NULL */
+#endif
+#ifdef RING_TRACE
+    struct trace_buf *trace;       /* this end's trace buffer, or NULL */
+#endif
+#ifdef RING_INLINE
+    struct msg stage[RING_BATCH];  /* messages of the next commit */
+    struct msg rx[RING_BATCH];     /* messages of the last recv */
+#else
+    size_t credit[RING_BATCH];
+#endif
+};
+
+static inline void transport_init(struct transport *t, struct fring *fring, struct aring *aring,
+                                  void *data_buf, doorbell_t doorbell, doorbell_t credit_ntfn) {
+    t->fring = fring;
+    t->aring = aring;
+    t->data_buf = data_buf;
+    t->doorbell = doorbell;
+    t->credit_ntfn = credit_ntfn;
+    t->credits = 0;
+    t->taken = 0;
+#ifdef RING_STATS
+    t->stats = NULL;
+#endif
+#ifdef RING_TRACE
+    t->trace = NULL;
+#endif
+}
+
+#ifdef RING_STATS
+static inline void transport_set_stats(struct transport *t, struct transport_stats *stats) {
+    t->stats = stats;
+}
+#endif
+
+#ifdef RING_TRACE
+static inline void transport_set_trace(struct transport *t, struct trace_buf *trace) {
+    t->trace = trace;
+}
+#endif
+
+/* signal if count entries posted from old include the one event waits for */
+static inline void transport_doorbell(struct transport *t, unsigned long old, size_t count) {
+    unsigned long event = atomic_load(&t->aring->event);
+
+    /* signal only if event lies in [old, old + count) */
+    if (old + count - event - 1 < count) {
+        t->aring->signals++;
+        STAT_INC(t->stats, signals);
+        TRACE(t->trace, TRACE_SIGNAL, TRACE_NO_SLOT, TRACE_DOORBELL);
+        doorbell_signal(t->doorbell);
+    }
+}
+
+/*
+ * Publish event before the caller looks at the ring once more. The fence
+ * pairs with the one after the sender's enqueue (ring_doorbell_fence()):
+ * either the receiver's next name_recv() sees the entry or the sender's
+ * transport_doorbell() sees event.
+ */
+static inline void transport_arm(struct transport *t) {
+    atomic_store(&t->aring->event, t->taken);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+#ifdef RING_INLINE
+
+_Static_assert((RING_BATCH & (RING_BATCH - 1)) == 0, "RING_BATCH must be a power of two");
+
+#define TRANSPORT_DEFINE(name, chan, slot_t)                                        \
+/* a credit is room for one message in the aring */                                 \
+static inline int name##_try_reserve(struct transport *t, size_t count) {           \
+    assert(count <= RING_BATCH);                                                    \
+    if (t->credits < count) {                                                       \
+        t->credits = chan##_space(t->aring, RING_BATCH);                            \
+    }                                                                               \
+    return t->credits < count ? TRANSPORT_WOULD_BLOCK : TRANSPORT_OK;               \
+}                                                                                   \
+                                                                                    \
+static inline void name##_reserve(struct transport *t, size_t count) {              \
+    while (name##_try_reserve(t, count) != TRANSPORT_OK) {                          \
+        STAT_INC(t->stats, spins);                                                  \
+        atomic_store(&t->aring->full, 1);                                           \
+        atomic_thread_fence(memory_order_seq_cst);                                  \
+        /* a recv may have made room before full went up */                         \
+        if (name##_try_reserve(t, count) == TRANSPORT_OK) {                         \
+            atomic_store(&t->aring->full, 0);                                       \
+            break;                                                                  \
+        }                                                                           \
+        STAT_INC(t->stats, credit_sleeps);                                          \
+        doorbell_wait(t->credit_ntfn);                                              \
+        TRACE(t->trace, TRACE_WAKE, TRACE_NO_SLOT, TRACE_CREDIT);                   \
+        atomic_store(&t->aring->full, 0);                                           \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_credits(struct transport *t) {                          \
+    name##_try_reserve(t, RING_BATCH);                                              \
+    return t->credits;                                                              \
+}                                                                                   \
+                                                                                    \
+static inline slot_t *name##_next(struct transport *t, size_t i) {                  \
+    return &t->stage[i];                                                            \
+}                                                                                   \
+                                                                                    \
+static inline void name##_commit(struct transport *t, size_t count) {               \
+    lfatomic_t value[RING_BATCH * INLINE_WORDS];                                    \
+    unsigned long old = atomic_load_explicit(&t->aring->posted,                     \
+                                             memory_order_relaxed);                 \
+    size_t i, w;                                                                    \
+                                                                                    \
+    assert(count <= t->credits);                                                    \
+    for (i = 0; i < count; i++) {                                                   \
+        for (w = 0; w < INLINE_WORDS; w++) {                                        \
+            value[i * INLINE_WORDS + w] = t->stage[i].word[w];                      \
+        }                                                                           \
+    }                                                                               \
+    /* the credits leave room, but a commit without them waits for it */            \
+    while (!chan##_send(t->aring, value, count, STAT_RING(t->stats, aring))) {      \
+        t->credits = 0;                                                             \
+        name##_reserve(t, count);                                                   \
+    }                                                                               \
+    t->credits -= count;                                                            \
+    for (i = 0; i < count; i++) {                                                   \
+        TRACE(t->trace, TRACE_ENQUEUE, old + i, 0);                                 \
+    }                                                                               \
+    atomic_fetch_add(&t->aring->posted, count);                                     \
+    transport_doorbell(t, old, count);                                              \
+}                                                                                   \
+                                                                                    \
+static inline int                                                                   \
+name##_try_send(struct transport *t, const slot_t *msg, size_t count) {             \
+    size_t i;                                                                       \
+                                                                                    \
+    if (name##_try_reserve(t, count) != TRANSPORT_OK) {                             \
+        return TRANSPORT_WOULD_BLOCK;                                               \
+    }                                                                               \
+    for (i = 0; i < count; i++) {                                                   \
+        *name##_next(t, i) = msg[i];                                                \
+    }                                                                               \
+    name##_commit(t, count);                                                        \
+    return TRANSPORT_OK;                                                            \
+}                                                                                   \
+                                                                                    \
+static inline void                                                                  \
+name##_send(struct transport *t, const slot_t *msg, size_t count) {                 \
+    size_t i;                                                                       \
+                                                                                    \
+    name##_reserve(t, count);                                                       \
+    for (i = 0; i < count; i++) {                                                   \
+        *name##_next(t, i) = msg[i];                                                \
+    }                                                                               \
+    name##_commit(t, count);                                                        \
+}                                                                                   \
+                                                                                    \
+static inline slot_t *name##_slot(struct transport *t, size_t idx) {                \
+    return &t->rx[idx & (RING_BATCH - 1)];                                          \
+}                                                                                   \
+                                                                                    \
+/* the messages are copied out already */                                          \
+static inline void name##_prefetch(struct transport *t, size_t idx) {               \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_recv(struct transport *t, size_t *idx, size_t count) {  \
+    lfatomic_t value[RING_BATCH * INLINE_WORDS];                                    \
+    size_t i, w;                                                                    \
+                                                                                    \
+    assert(count <= RING_BATCH);                                                    \
+    count = chan##_recv(t->aring, value, count, STAT_RING(t->stats, aring));        \
+    for (i = 0; i < count; i++) {                                                   \
+        idx[i] = t->taken + i;                                                      \
+        for (w = 0; w < INLINE_WORDS; w++) {                                        \
+            name##_slot(t, idx[i])->word[w] = value[i * INLINE_WORDS + w];          \
+        }                                                                           \
+    }                                                                               \
+    TRACE_SLOTS(t->trace, TRACE_DEQUEUE, idx, count);                               \
+    t->taken += count;                                                              \
+    return count;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline void                                                                  \
+name##_release(struct transport *t, const size_t *idx, size_t count) {              \
+    TRACE_SLOTS(t->trace, TRACE_FREE, idx, count);                                  \
+    /* pairs with the fence in name_reserve(), the recv made room */                \
+    atomic_thread_fence(memory_order_seq_cst);                                      \
+    if (atomic_load_explicit(&t->aring->full, memory_order_relaxed)) {              \
+        STAT_INC(t->stats, signals);                                                \
+        TRACE(t->trace, TRACE_SIGNAL, TRACE_NO_SLOT, TRACE_CREDIT);                 \
+        doorbell_signal(t->credit_ntfn);                                            \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+/* a post that was not seen by a name_recv() after this will signal */              \
+static inline void name##_arm(struct transport *t) {                                \
+    transport_arm(t);                                                               \
+}
+
+#else
+
+#define TRANSPORT_DEFINE(name, chan, slot_t)                                        \
+static inline int name##_try_reserve(struct transport *t, size_t count) {           \
+    assert(count <= RING_BATCH);                                                    \
+    if (t->credits < count) {                                                       \
+        size_t got = chan##_alloc(t->fring, t->credit + t->credits,                 \
+                                  RING_BATCH - t->credits,                          \
+                                  STAT_RING(t->stats, fring));                      \
+        TRACE_SLOTS(t->trace, TRACE_ALLOC, t->credit + t->credits, got);            \
+        t->credits += got;                                                          \
+    }                                                                               \
+    return t->credits < count ? TRANSPORT_WOULD_BLOCK : TRANSPORT_OK;               \
+}                                                                                   \
+                                                                                    \
+static inline void name##_reserve(struct transport *t, size_t count) {              \
+    while (name##_try_reserve(t, count) != TRANSPORT_OK) {                          \
+        STAT_INC(t->stats, spins);                                                  \
+        atomic_store(&t->fring->readers, -1);                                       \
+        atomic_thread_fence(memory_order_seq_cst);                                  \
+        /* a release may have come in before readers went down */                   \
+        if (name##_try_reserve(t, count) == TRANSPORT_OK) {                         \
+            atomic_store(&t->fring->readers, 1);                                    \
+            break;                                                                  \
+        }                                                                           \
+        STAT_INC(t->stats, credit_sleeps);                                          \
+        doorbell_wait(t->credit_ntfn);                                              \
+        TRACE(t->trace, TRACE_WAKE, TRACE_NO_SLOT, TRACE_CREDIT);                   \
+        atomic_store(&t->fring->readers, 1);                                        \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_credits(struct transport *t) {                          \
+    name##_try_reserve(t, RING_BATCH);                                              \
+    return t->credits;                                                              \
+}                                                                                   \
+                                                                                    \
+/* credits are used from the bottom, so a top-up does not move staged slots */     \
+static inline slot_t *name##_next(struct transport *t, size_t i) {                  \
+    return chan##_slot(t->data_buf, t->credit[i]);                                  \
+}                                                                                   \
+                                                                                    \
+static inline void                                                                  \
+name##_post(struct transport *t, const size_t *idx, size_t count) {                 \
+    unsigned long old;                                                              \
+                                                                                    \
+    chan##_post(t->aring, idx, count, STAT_RING(t->stats, aring));                  \
+    TRACE_SLOTS(t->trace, TRACE_ENQUEUE, idx, count);                               \
+    old = atomic_fetch_add(&t->aring->posted, count);                               \
+    transport_doorbell(t, old, count);                                              \
+}                                                                                   \
+                                                                                    \
+static inline void name##_commit(struct transport *t, size_t count) {               \
+    size_t i, idx[RING_BATCH];                                                      \
+                                                                                    \
+    assert(count <= t->credits);                                                    \
+    for (i = 0; i < count; i++) {                                                   \
+        idx[i] = t->credit[i];                                                      \
+    }                                                                               \
+    t->credits -= count;                                                            \
+    for (i = 0; i < t->credits; i++) {                                              \
+        t->credit[i] = t->credit[count + i];                                        \
+    }                                                                               \
+    name##_post(t, idx, count);                                                     \
+}                                                                                   \
+                                                                                    \
+static inline int                                                                   \
+name##_try_send(struct transport *t, const slot_t *msg, size_t count) {             \
+    size_t i;                                                                       \
+                                                                                    \
+    if (name##_try_reserve(t, count) != TRANSPORT_OK) {                             \
+        return TRANSPORT_WOULD_BLOCK;                                               \
+    }                                                                               \
+    for (i = 0; i < count; i++) {                                                   \
+        *name##_next(t, i) = msg[i];                                                \
+    }                                                                               \
+    name##_commit(t, count);                                                        \
+    return TRANSPORT_OK;                                                            \
+}                                                                                   \
+                                                                                    \
+static inline void                                                                  \
+name##_send(struct transport *t, const slot_t *msg, size_t count) {                 \
+    size_t i;                                                                       \
+                                                                                    \
+    name##_reserve(t, count);                                                       \
+    for (i = 0; i < count; i++) {                                                   \
+        *name##_next(t, i) = msg[i];                                                \
+    }                                                                               \
+    name##_commit(t, count);                                                        \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_recv(struct transport *t, size_t *idx, size_t count) {  \
+    count = chan##_recv(t->aring, idx, count, STAT_RING(t->stats, aring));          \
+    TRACE_SLOTS(t->trace, TRACE_DEQUEUE, idx, count);                               \
+    t->taken += count;                                                              \
+    return count;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline slot_t *name##_slot(struct transport *t, size_t idx) {                \
+    return chan##_slot(t->data_buf, idx);                                           \
+}                                                                                   \
+                                                                                    \
+static inline void name##_prefetch(struct transport *t, size_t idx) {               \
+    if (RING_PREFETCH) {                                                            \
+        __builtin_prefetch(name##_slot(t, idx), 0);                                 \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+static inline void                                                                  \
+name##_release(struct transport *t, const size_t *idx, size_t count) {              \
+    chan##_free(t->fring, idx, count, STAT_RING(t->stats, fring));                  \
+    TRACE_SLOTS(t->trace, TRACE_FREE, idx, count);                                  \
+    if (atomic_load(&t->fring->readers) < 0) {                                      \
+        STAT_INC(t->stats, signals);                                                \
+        TRACE(t->trace, TRACE_SIGNAL, TRACE_NO_SLOT, TRACE_CREDIT);                 \
+        doorbell_signal(t->credit_ntfn);                                            \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+/* a post that was not seen by a name_recv() after this will signal */              \
+static inline void name##_arm(struct transport *t) {                                \
+    transport_arm(t);                                                               \
+}
+
+#endif
+
+TRANSPORT_DEFINE(req, req_chan, struct msg)
+TRANSPORT_DEFINE(rsp, rsp_chan, struct msg)
+
+#endif
@@ -0,0 +1,386 @@
+/*
+ * Linux host harness for the ring transport.
+ *
+ * Runs the ring.h, transport.h and client.h code of the seL4 image on
+ * Linux, with mmap()'d shared memory in place of the shared frames and
+ * futex doorbells (doorbell.h) in place of notifications. The app side
+ * echoes requests back with the loop app.c runs (receiver.h), from a
+ * thread or from a forked process; main submits through a struct client
+ * and a receiver thread completes the responses with main.c's loop.
+ *
+ * Three benchmarks are run:
+ *
+ *   ping-pong   one request in flight at a time, round-trip latency
+ *   throughput  CLIENT_MAX_WINDOW requests in flight, committed RING_BATCH
+ *               at a time, messages per second
+ *   load        open-loop latency against offered load (loadgen.h), with
+ *               constant and Poisson arrivals
+ *
+ * Build and run on Linux from the top of the tree:
+ *
+ *   gcc -std=gnu11 -O2 -pthread -DRING_HOST -Isrc/include tools/ring_host.c -o ring_host
+ *   ./ring_host [thread|process] [requests]
+ *
+ * The ring types and orders are those of ring.h; POLL_MODE and the poll
+ * budgets may be set with -D as for the seL4 build, -DRING_STATS adds the
+ * counters of stats.h, -DRING_TRACE the trace of trace.h and -DRING_PMU
+ * the per-thread hardware counters of pmu.h, -DRING_INPLACE has app answer
+ * in the request slots, -DRING_INLINE carries messages in the arings,
+ * -DRING_SLOT_ISOLATE spreads the slots a cache line apart and
+ * -DRING_LARGE_PAGES maps the shared region in huge pages (ring.h):
+ *
+ *   ./ring_host thread 10000 | tools/trace_timeline.py
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../src/ring.h"
+#include "../src/transport.h"
+#include "../src/poll.h"
+#include "../src/client.h"
+#include "../src/receiver.h"
+#include "../src/loadgen.h"
+
+/* the badges main.c mints its caps with, plus one to stop a loop */
+#define REQ_DOORBELL_BADGE (1U << 0) /* app: requests posted */
+#define RSP_CREDIT_BADGE   (1U << 1) /* app: response slots returned */
+#define REQ_CREDIT_BADGE   (1U << 0) /* main: request slots returned */
+#define DONE_BADGE         (1U << 1) /* main: the receiver completed requests */
+#define RSP_DOORBELL_BADGE (1U << 0) /* receiver: responses posted */
+#define STOP_BADGE         (1U << 2) /* app, receiver: leave the loop */
+
+#define DEFAULT_REQUESTS 1000000
+
+/* the notification words, in the page after the rings */
+struct host_ntfns {
+    _Alignas(LF_CACHE_BYTES) _Atomic(uint32_t) app;
+    _Alignas(LF_CACHE_BYTES) _Atomic(uint32_t) main;
+    _Alignas(LF_CACHE_BYTES) _Atomic(uint32_t) receiver;
+    _Atomic(int) stop;
+};
+
+#define DOORBELL(word, badge) ((doorbell_t){ &ntfns->word, (badge) })
+
+static void *shared_mem;
+static struct host_ntfns *ntfns;
+
+static struct transport req_tp; /* main: sending end of the request channel */
+static struct transport rsp_tp; /* main: receiving end of the response channel */
+static struct poller rsp_poll;
+static struct client client;
+static struct histogram rtt;
+#ifdef RING_PMU
+static struct pmu pmu; /* main's thread */
+static struct pmu_block receiver_pmu; /* published by the receiver thread */
+#endif
+
+static void init_rings(void) {
+    struct fring *req_fring = REQ_FRING(shared_mem), *rsp_fring = RSP_FRING(shared_mem);
+    struct aring *req_aring = REQ_ARING(shared_mem), *rsp_aring = RSP_ARING(shared_mem);
+
+    layout_init(LAYOUT(shared_mem));
+    req_chan_init(req_fring, req_aring, REQ_BUFFER_SIZE);
+#ifdef RING_INPLACE
+    ring_init_empty(RSP_ARING_TYPE, rsp_aring->ring, RSP_RING_ORDER);
+#else
+    rsp_chan_init(rsp_fring, rsp_aring, RSP_BUFFER_SIZE);
+#endif
+
+#ifndef RING_INLINE
+    atomic_init(&req_fring->readers, 1);
+    atomic_init(&rsp_fring->readers, 1);
+#endif
+    atomic_init(&req_aring->event, 0);
+    atomic_init(&rsp_aring->event, 0);
+    atomic_init(&req_aring->posted, 0);
+    atomic_init(&rsp_aring->posted, 0);
+    atomic_init(&req_aring->full, 0);
+    atomic_init(&rsp_aring->full, 0);
+    req_aring->waits = req_aring->signals = 0;
+    rsp_aring->waits = rsp_aring->signals = 0;
+    atomic_init(&req_aring->poll_mode, POLL_MODE);
+    atomic_init(&rsp_aring->poll_mode, POLL_MODE);
+
+    atomic_init(&ntfns->app, 0);
+    atomic_init(&ntfns->main, 0);
+    atomic_init(&ntfns->receiver, 0);
+    atomic_init(&ntfns->stop, 0);
+#ifdef RING_STATS
+    stats_init(STATS(shared_mem));
+#endif
+#ifdef RING_TRACE
+    trace_init(TRACE_AREA(shared_mem));
+#endif
+#ifdef RING_PMU
+    pmu_block_init(PMU_BLOCK(shared_mem));
+    pmu_block_init(&receiver_pmu);
+#endif
+}
+
+/* app.c's side: echo every request back as a response */
+static void app(void) {
+    const struct layout *layout = LAYOUT(shared_mem);
+    struct transport app_req_tp, app_rsp_tp;
+    struct poller req_poll;
+    struct receiver r;
+    struct aring *req_aring;
+#ifdef RING_PMU
+    struct pmu_block *pmu_block;
+    struct pmu app_pmu;
+#endif
+
+    /* as app.c, find the rings through main's header */
+    layout_check(layout);
+    req_aring = layout_region(shared_mem, layout, &layout->req.aring);
+    transport_init(&app_req_tp, layout_region(shared_mem, layout, &layout->req.fring),
+                   req_aring, layout_region(shared_mem, layout, &layout->req.data),
+                   DOORBELL_NULL, DOORBELL(main, REQ_CREDIT_BADGE));
+    transport_init(&app_rsp_tp, layout_region(shared_mem, layout, &layout->rsp.fring),
+                   layout_region(shared_mem, layout, &layout->rsp.aring),
+                   layout_region(shared_mem, layout, &layout->rsp.data),
+                   DOORBELL(receiver, RSP_DOORBELL_BADGE), DOORBELL(app, RSP_CREDIT_BADGE));
+    poll_init(&req_poll, &req_aring->poll_mode);
+#ifdef RING_STATS
+    struct stats_page *stats = layout_region(shared_mem, layout, &layout->stats);
+
+    transport_set_stats(&app_req_tp, &stats->req_recv);
+    transport_set_stats(&app_rsp_tp, &stats->rsp_send);
+#endif
+#ifdef RING_TRACE
+    struct trace_area *trace = layout_region(shared_mem, layout, &layout->trace);
+
+    transport_set_trace(&app_req_tp, &trace->req_recv);
+    transport_set_trace(&app_rsp_tp, &trace->rsp_send);
+#endif
+#ifdef RING_PMU
+    pmu_block = layout_region(shared_mem, layout, &layout->pmu);
+    pmu_open(&app_pmu, 0);
+    pmu_publish(pmu_block, &app_pmu, 0);
+#endif
+
+    receiver_init(&r, &app_req_tp, &req_poll, DOORBELL(app, 0), &ntfns->stop);
+#ifdef RING_PMU
+    receiver_set_pmu(&r, &app_pmu, pmu_block);
+#endif
+    receiver_echo(&r, &app_rsp_tp);
+}
+
+static void *app_thread(void *arg) {
+    app();
+    return NULL;
+}
+
+/* main.c's receiver thread: complete every response */
+static void *receiver(void *arg) {
+    struct receiver r;
+#ifdef RING_PMU
+    struct pmu thread_pmu;
+
+    pmu_open(&thread_pmu, 0);
+    pmu_publish(&receiver_pmu, &thread_pmu, 0);
+#endif
+
+    receiver_init(&r, &rsp_tp, &rsp_poll, DOORBELL(receiver, 0), &ntfns->stop);
+#ifdef RING_PMU
+    receiver_set_pmu(&r, &thread_pmu, &receiver_pmu);
+#endif
+    receiver_complete(&r, &client);
+    return NULL;
+}
+
+static void complete(void *arg, const struct msg *rsp) {
+    assert(rsp->word[1] == rsp->word[0] + 1);
+}
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* TSC frequency against the monotonic clock, where CPUID does not give it */
+static void calibrate_hz(void) {
+    uint64_t t0, t1, c0, c1;
+
+    t0 = wall_ns();
+    c0 = poll_now();
+    while (wall_ns() - t0 < 100000000) {
+    }
+    c1 = poll_now();
+    t1 = wall_ns();
+    counter_calibration()->hz = (c1 - c0) * 1000000000 / (t1 - t0);
+}
+
+static void bench(const char *name, size_t window, size_t batch, unsigned long requests) {
+    struct msg msg = {0};
+    unsigned long base = client.issued;
+    uint64_t t0, t1, ns;
+#ifdef RING_PMU
+    struct pmu_sample main0, main1, receiver0, receiver1, app0, app1;
+    char row[64];
+#endif
+
+    client_set_window(&client, window);
+    client_set_batch(&client, batch);
+    hist_init(&rtt);
+    client.rtt = &rtt;
+
+#ifdef RING_PMU
+    pmu_snapshot(PMU_BLOCK(shared_mem), base, &app0);
+    pmu_snapshot(&receiver_pmu, base, &receiver0);
+    pmu_read(&pmu, &main0);
+#endif
+    t0 = wall_ns();
+    for (unsigned long i = 0; i < requests; i++) {
+        msg.word[1] = base + i + 1;
+        client_submit(&client, &msg, complete, NULL);
+    }
+    client_drain(&client);
+    t1 = wall_ns();
+    ns = t1 - t0;
+#ifdef RING_PMU
+    pmu_read(&pmu, &main1);
+    pmu_snapshot(&receiver_pmu, client.issued, &receiver1);
+    pmu_snapshot(PMU_BLOCK(shared_mem), client.issued, &app1);
+#endif
+
+    printf("%s: window %zu batch %zu: %lu requests in %lu ns, %lu ns per request, %lu msgs/s\n",
+        name, window, batch, requests, (unsigned long)ns, (unsigned long)(ns / requests),
+        ns != 0 ? (unsigned long)(requests * 1000000000.0 / ns) : 0);
+    hist_print(&rtt, name);
+#ifdef RING_PMU
+    snprintf(row, sizeof(row), "%s_main", name);
+    pmu_print(row, &main0, &main1, requests);
+    snprintf(row, sizeof(row), "%s_receiver", name);
+    pmu_print(row, &receiver0, &receiver1, requests);
+    snprintf(row, sizeof(row), "%s_app", name);
+    pmu_print(row, &app0, &app1, requests);
+#endif
+}
+
+/* anonymous shared memory in MAP_BITS pages, the ntfns in the last one */
+static void *map_shared(size_t len) {
+    void *mem;
+
+#ifdef RING_LARGE_PAGES
+    mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB |
+               (MAP_BITS << MAP_HUGE_SHIFT), -1, 0);
+    if (mem != MAP_FAILED) {
+        printf("ring_host: shared region in %lu hugetlb pages\n", (unsigned long)(len >> MAP_BITS));
+        return mem;
+    }
+    /* no huge pages reserved, see /proc/sys/vm/nr_hugepages */
+    printf("ring_host: no hugetlb pages, asking for transparent huge pages instead\n");
+#endif
+    mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(mem != MAP_FAILED);
+#ifdef RING_LARGE_PAGES
+    madvise(mem, len, MADV_HUGEPAGE);
+#endif
+    return mem;
+}
+
+int main(int argc, char **argv) {
+    int process = argc > 1 && strcmp(argv[1], "process") == 0;
+    unsigned long requests = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_REQUESTS;
+    struct aring *req_aring, *rsp_aring;
+    pthread_t app_tid, receiver_tid;
+    pid_t pid = 0;
+
+    assert(requests > 0);
+
+    /* the processes share the mapping at one address, as LSCQ needs */
+    shared_mem = map_shared((SHARED_PAGES + MAP_PAGES) * PAGE_SIZE);
+    ntfns = (struct host_ntfns *)((char *)shared_mem + SHARED_PAGES * PAGE_SIZE);
+    req_aring = REQ_ARING(shared_mem);
+    rsp_aring = RSP_ARING(shared_mem);
+
+    counter_init();
+    if (counter_calibration()->hz == 0) {
+        calibrate_hz();
+    }
+    init_rings();
+#ifdef RING_PMU
+    pmu_open(&pmu, 0);
+    printf("ring_host: pmu %s\n", pmu_available(&pmu) ? "counting" : "unavailable, pmu rows read 0");
+#endif
+
+    printf("ring_host: app in a %s, req_fring %s, rsp_fring %s, req_aring %s, rsp_aring %s, "
+           "poll mode %s, replies %s, slot stride req %u rsp %u, prefetch %d, %s pages\n",
+        process ? "process" : "thread", FRING_NAME(REQ_FRING_TYPE), FRING_NAME(RSP_FRING_TYPE),
+        ARING_NAME(REQ_ARING_TYPE), ARING_NAME(RSP_ARING_TYPE), POLL_MODE_NAME(POLL_MODE),
+        RING_REPLIES, (unsigned)REQ_SLOT_STRIDE, (unsigned)RSP_SLOT_STRIDE, RING_PREFETCH,
+        RING_PAGING);
+    layout_print("ring_host", LAYOUT(shared_mem));
+    printf("ring_host: counter overhead %lu cycles, frequency %lu Hz\n",
+        (unsigned long)counter_calibration()->overhead, (unsigned long)counter_calibration()->hz);
+
+    if (process) {
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            app();
+            _exit(0);
+        }
+    } else {
+        pthread_create(&app_tid, NULL, app_thread, NULL);
+    }
+
+    transport_init(&req_tp, REQ_FRING(shared_mem), req_aring, REQ_DATA_BUF(shared_mem),
+                   DOORBELL(app, REQ_DOORBELL_BADGE), DOORBELL(main, REQ_CREDIT_BADGE));
+#ifdef RING_INPLACE
+    /* the receiver frees request slots and wakes main for them */
+    transport_init(&rsp_tp, RSP_FRING(shared_mem), rsp_aring, RSP_DATA_BUF(shared_mem),
+                   DOORBELL_NULL, DOORBELL(main, REQ_CREDIT_BADGE));
+#else
+    transport_init(&rsp_tp, RSP_FRING(shared_mem), rsp_aring, RSP_DATA_BUF(shared_mem),
+                   DOORBELL_NULL, DOORBELL(app, RSP_CREDIT_BADGE));
+#endif
+    poll_init(&rsp_poll, &rsp_aring->poll_mode);
+#ifdef RING_STATS
+    transport_set_stats(&req_tp, &STATS(shared_mem)->req_send);
+    transport_set_stats(&rsp_tp, &STATS(shared_mem)->rsp_recv);
+#endif
+#ifdef RING_TRACE
+    transport_set_trace(&req_tp, &TRACE_AREA(shared_mem)->req_send);
+    transport_set_trace(&rsp_tp, &TRACE_AREA(shared_mem)->rsp_recv);
+#endif
+    client_init(&client, &req_tp, DOORBELL(main, 0), DOORBELL(main, DONE_BADGE), 1);
+    pthread_create(&receiver_tid, NULL, receiver, NULL);
+
+    bench("ping-pong", 1, 1, requests);
+    bench("throughput", CLIENT_MAX_WINDOW, RING_BATCH, requests);
+    load_sweep(&client, &rtt, LOAD_CONSTANT);
+    load_sweep(&client, &rtt, LOAD_POISSON);
+
+    printf("doorbells: req sent %lu needed %lu, rsp sent %lu needed %lu\n",
+        req_aring->signals, req_aring->waits, rsp_aring->signals, rsp_aring->waits);
+#ifdef RING_STATS
+    stats_print(STATS(shared_mem));
+#endif
+#ifdef RING_TRACE
+    trace_dump(TRACE_AREA(shared_mem));
+#endif
+
+    atomic_store(&ntfns->stop, 1);
+    doorbell_signal(DOORBELL(app, STOP_BADGE));
+    doorbell_signal(DOORBELL(receiver, STOP_BADGE));
+    pthread_join(receiver_tid, NULL);
+    if (process) {
+        waitpid(pid, NULL, 0);
+    } else {
+        pthread_join(app_tid, NULL);
+    }
+    return 0;
+}
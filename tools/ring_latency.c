@@ -0,0 +1,176 @@
+/*
+ * Host stress benchmark comparing the enqueue latency of the SCQ ring
+ * (lfring.h) with the wait-free wCQ ring (wfring.h) under many producers.
+ *
+ * Every thread owns a few indices and keeps moving them through one shared
+ * ring: it dequeues an index and enqueues it again, timing each enqueue with
+ * the TSC. The ring has room for all indices, so every enqueue eventually
+ * succeeds and its cost is all contention. Per ring type it prints the
+ * median, p99, p99.9 and maximum enqueue latency in cycles.
+ *
+ * It also checks that the ring loses and duplicates nothing: an index must
+ * never be dequeued while another thread holds it, and once all threads
+ * are done the ring must give back every index exactly once. A failed
+ * check makes the exit status non-zero.
+ *
+ * Build and run on Linux (x86-64 or any target with a C11 compiler):
+ *
+ *   gcc -std=gnu11 -O2 -pthread -Isrc/include tools/ring_latency.c -o ring_latency
+ *   ./ring_latency [threads] [operations per thread]
+ *
+ * Low WFRING_PATIENCE values (-DWFRING_PATIENCE=1) force the wCQ slow path.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "lfring.h"
+#include "wfring.h"
+
+#define ORDER       10
+#define MAX_THREADS 64
+
+enum { SCQ, WCQ };
+
+static _Alignas(LF_CACHE_BYTES) char ring[WFRING_SIZE(ORDER, MAX_THREADS)];
+static int ring_type;
+static size_t threads, ops;
+static uint64_t *samples;
+static pthread_barrier_t barrier;
+/* which indices a thread holds, and how often that was violated */
+static _Atomic(unsigned char) held[1U << ORDER];
+static _Atomic(unsigned long) violations;
+
+static inline uint64_t now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void *worker(void *arg) {
+    size_t tid = (size_t) arg, i, eidx;
+    uint64_t *lat = samples + tid * ops, t0, t1;
+
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < ops; i++) {
+        do {
+            eidx = ring_type == WCQ ?
+                   wfring_dequeue((struct wfring *) ring, ORDER, false, tid) :
+                   lfring_dequeue((struct lfring *) ring, ORDER, false);
+        } while (eidx == LFRING_EMPTY);
+
+        /* no other thread may hold eidx until it is enqueued again */
+        if (eidx >= lfring_pow2(ORDER) || atomic_exchange(&held[eidx], 1) != 0) {
+            atomic_fetch_add(&violations, 1);
+            continue;
+        }
+        atomic_store(&held[eidx], 0);
+
+        t0 = now();
+        if (ring_type == WCQ) {
+            wfring_enqueue((struct wfring *) ring, ORDER, eidx, false, tid);
+        } else {
+            lfring_enqueue((struct lfring *) ring, ORDER, eidx, false);
+        }
+        t1 = now();
+        lat[i] = t1 - t0;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* drain the ring: every index must come back exactly once */
+static unsigned long drain(void) {
+    static unsigned char seen[1U << ORDER];
+    unsigned long bad = 0;
+    size_t eidx, n = 0;
+
+    memset(seen, 0, sizeof(seen));
+    for (;;) {
+        eidx = ring_type == WCQ ? wfring_dequeue((struct wfring *) ring, ORDER, false, 0) :
+                                  lfring_dequeue((struct lfring *) ring, ORDER, false);
+        if (eidx == LFRING_EMPTY) {
+            break;
+        }
+        if (eidx >= lfring_pow2(ORDER) || seen[eidx]++) {
+            bad++;
+        }
+        n++;
+    }
+    return bad + (n > lfring_pow2(ORDER) ? n - lfring_pow2(ORDER) : lfring_pow2(ORDER) - n);
+}
+
+static int run(int type, const char *name) {
+    pthread_t tid[MAX_THREADS];
+    size_t i, total = threads * ops;
+    unsigned long lost;
+
+    /* the ring starts out holding every index */
+    ring_type = type;
+    atomic_store(&violations, 0);
+    if (type == WCQ) {
+        wfring_init_fill((struct wfring *) ring, 0, lfring_pow2(ORDER), ORDER, threads);
+    } else {
+        lfring_init_fill((struct lfring *) ring, 0, lfring_pow2(ORDER), ORDER);
+    }
+
+    pthread_barrier_init(&barrier, NULL, threads);
+    for (i = 0; i < threads; i++) {
+        pthread_create(&tid[i], NULL, worker, (void *) i);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    pthread_barrier_destroy(&barrier);
+    lost = drain();
+
+    qsort(samples, total, sizeof(*samples), cmp_u64);
+    printf("%s: %zu threads, p50 %lu p99 %lu p99.9 %lu max %lu\n", name, threads,
+           (unsigned long) samples[total / 2], (unsigned long) samples[total / 100 * 99],
+           (unsigned long) samples[total / 1000 * 999], (unsigned long) samples[total - 1]);
+    if (violations != 0 || lost != 0) {
+        fprintf(stderr, "%s: %lu indices held twice, %lu lost or duplicated at the end\n",
+                name, (unsigned long) violations, lost);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int err = 0;
+
+    threads = argc > 1 ? strtoul(argv[1], NULL, 0) : 8;
+    ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+    if (threads == 0 || threads > MAX_THREADS || ops == 0) {
+        fprintf(stderr, "usage: %s [threads (1-%d)] [operations per thread]\n",
+                argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    samples = calloc(threads * ops, sizeof(*samples));
+    if (samples == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    err |= run(SCQ, "scq");
+    err |= run(WCQ, "wcq");
+
+    free(samples);
+    return err;
+}
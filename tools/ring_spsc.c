@@ -0,0 +1,174 @@
+/*
+ * Host benchmark of one producer and one consumer on two threads, comparing
+ * the SPSC ring (spscring.h) with the SCQ ring (lfring.h).
+ *
+ * The threads pass indices around a pair of rings the way the transport
+ * does: the producer takes a batch of free indices from the free ring and
+ * enqueues it on the post ring, and the consumer dequeues from the post
+ * ring and returns what it got to the free ring. Both rings are of ORDER
+ * and the free ring starts out holding every index, so neither ring can
+ * fill. Unlike the benchmark in main.c, which calls both ends from one
+ * thread, the index caches and cache lines of each side here are really
+ * pulled between two cores.
+ *
+ * Per ring type and batch size it prints the cycles per index moved and
+ * checks that every index came back to the free ring exactly once.
+ *
+ * Build and run on Linux (x86-64 or any target with a C11 compiler):
+ *
+ *   gcc -std=gnu11 -O2 -pthread -Isrc/include tools/ring_spsc.c -o ring_spsc
+ *   ./ring_spsc [indices moved per run]
+ *
+ * Both threads spin, so run it with at least two CPUs; on one they only
+ * trade time slices and every index costs a scheduler tick.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "lfring.h"
+#include "spscring.h"
+
+#define ORDER     10
+#define MAX_BATCH 32
+
+enum { SCQ, SPSC };
+
+static _Alignas(LFRING_ALIGN) char free_ring[LFRING_SIZE(ORDER)];
+static _Alignas(LFRING_ALIGN) char post_ring[LFRING_SIZE(ORDER)];
+static int ring_type;
+static size_t batch, ops;
+static pthread_barrier_t barrier;
+
+static inline uint64_t now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static size_t take(char *ring, size_t *eidx, size_t count) {
+    if (ring_type == SPSC) {
+        return spscring_dequeue_batch((struct spscring *) ring, ORDER, eidx, count, NULL);
+    }
+    return lfring_dequeue_batch((struct lfring *) ring, ORDER, eidx, count, false, NULL);
+}
+
+static void give(char *ring, const size_t *eidx, size_t count) {
+    if (ring_type == SPSC) {
+        if (!spscring_enqueue_batch((struct spscring *) ring, ORDER, eidx, count, NULL)) {
+            fprintf(stderr, "ring_spsc: SPSC ring full\n");
+            abort();
+        }
+    } else {
+        lfring_enqueue_batch((struct lfring *) ring, ORDER, eidx, count, false, NULL);
+    }
+}
+
+static void *producer(void *arg) {
+    size_t eidx[MAX_BATCH], moved = 0, n;
+
+    pthread_barrier_wait(&barrier);
+    while (moved < ops) {
+        n = take(free_ring, eidx, ops - moved < batch ? ops - moved : batch);
+        if (n != 0) {
+            give(post_ring, eidx, n);
+            moved += n;
+        }
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    size_t eidx[MAX_BATCH], moved = 0, n;
+
+    pthread_barrier_wait(&barrier);
+    while (moved < ops) {
+        n = take(post_ring, eidx, batch);
+        if (n != 0) {
+            give(free_ring, eidx, n);
+            moved += n;
+        }
+    }
+    return NULL;
+}
+
+/* every index must be back in the free ring, once */
+static int check(void) {
+    static unsigned char seen[1U << ORDER];
+    size_t eidx[MAX_BATCH], i, n, total = 0;
+
+    memset(seen, 0, sizeof(seen));
+    while ((n = take(free_ring, eidx, MAX_BATCH)) != 0) {
+        for (i = 0; i < n; i++) {
+            if (eidx[i] >= lfring_pow2(ORDER) || seen[eidx[i]]++) {
+                fprintf(stderr, "ring_spsc: index %zu out of range or seen twice\n", eidx[i]);
+                return 1;
+            }
+        }
+        total += n;
+    }
+    if (take(post_ring, eidx, 1) != 0 || total != lfring_pow2(ORDER)) {
+        fprintf(stderr, "ring_spsc: %zu of %zu indices back in the free ring\n", total,
+                lfring_pow2(ORDER));
+        return 1;
+    }
+    return 0;
+}
+
+static int run(int type, const char *name, size_t b) {
+    pthread_t prod, cons;
+    uint64_t t0, t1;
+
+    ring_type = type;
+    batch = b;
+    if (type == SPSC) {
+        spscring_init_fill((struct spscring *) free_ring, 0, lfring_pow2(ORDER), ORDER);
+        spscring_init_empty((struct spscring *) post_ring, ORDER);
+    } else {
+        lfring_init_fill((struct lfring *) free_ring, 0, lfring_pow2(ORDER), ORDER);
+        lfring_init_empty((struct lfring *) post_ring, ORDER);
+    }
+
+    /* the main thread joins the barrier too, so t0 is taken as both threads start */
+    pthread_barrier_init(&barrier, NULL, 3);
+    pthread_create(&prod, NULL, producer, NULL);
+    pthread_create(&cons, NULL, consumer, NULL);
+    pthread_barrier_wait(&barrier);
+    t0 = now();
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    t1 = now();
+    pthread_barrier_destroy(&barrier);
+
+    printf("%s: batch %zu, %zu indices, %lu cycles per index\n", name, batch, ops,
+           (unsigned long) ((t1 - t0) / ops));
+    return check();
+}
+
+int main(int argc, char **argv) {
+    static const size_t batches[] = {1, 4, MAX_BATCH};
+    size_t i;
+    int err = 0;
+
+    ops = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+    if (ops == 0) {
+        fprintf(stderr, "usage: %s [indices moved per run]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+        err |= run(SPSC, "spsc", batches[i]);
+        err |= run(SCQ, "scq", batches[i]);
+    }
+    return err;
+}
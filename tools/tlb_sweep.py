@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+Compare small and large page backing of the shared region on the host.
+
+Builds tools/ring_host once per configuration with -DRING_PMU, from packed
+slots in a small buffer, which touch few pages, to one slot per page in a
+big buffer, which touches a page per message, each with and without
+-DRING_LARGE_PAGES. Runs each build and prints a CSV row per configuration
+with the throughput benchmark's ns per request and the L1 dTLB misses per
+message of main, main's receiver thread and app.
+
+Large pages come from hugetlbfs when pages are reserved in
+/proc/sys/vm/nr_hugepages and from transparent huge pages otherwise, as
+ring_host reports on its first line. On seL4 build the image with and
+without -DRING_LARGE_PAGES and compare the sweep's dtlb_miss pmu rows.
+
+  tools/tlb_sweep.py [--mode thread|process] [--requests N] [--cc CC]
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import tempfile
+
+TOP = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# (name, buffer order, slot stride); the aring order follows the buffer order
+CONFIGS = [("packed", 10, 32), ("line", 12, 128), ("page", 12, 4096)]
+PAGING = [("small", []), ("large", ["-DRING_LARGE_PAGES"])]
+SIDES = ["main", "receiver", "app"]
+
+THROUGHPUT = re.compile(r"^throughput: .* (\d+) ns per request")
+PMU = re.compile(r"^pmu,throughput_(\w+),.*dtlb_miss,([\d.]+)")
+
+
+def build(cc, out, order, stride, flags):
+    subprocess.check_call(
+        [cc, "-std=gnu11", "-O2", "-pthread", "-DRING_HOST", "-DRING_PMU",
+         "-DRING_ORDER=%d" % order, "-DBUFFER_ORDER=%d" % order,
+         "-DREQ_SLOT_STRIDE=%d" % stride, "-DRSP_SLOT_STRIDE=%d" % stride]
+        + flags + ["-I" + os.path.join(TOP, "src", "include"),
+                   os.path.join(TOP, "tools", "ring_host.c"), "-o", out])
+
+
+def run(binary, mode, requests):
+    ns, dtlb = "", {}
+    log = subprocess.run([binary, mode, str(requests)], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True).stdout
+    for line in log.splitlines():
+        m = THROUGHPUT.match(line)
+        if m:
+            ns = m.group(1)
+        m = PMU.match(line)
+        if m:
+            dtlb[m.group(1)] = m.group(2)
+    return ns, dtlb
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--mode", default="process", choices=["thread", "process"])
+    parser.add_argument("--requests", type=int, default=1000000)
+    parser.add_argument("--cc", default="gcc")
+    args = parser.parse_args()
+
+    print("tlb,config,buffer_order,stride,paging,ns_per_msg," +
+          ",".join(s + "_dtlb_miss" for s in SIDES))
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, order, stride in CONFIGS:
+            for paging, flags in PAGING:
+                binary = os.path.join(tmp, "ring_host_%s_%s" % (name, paging))
+                build(args.cc, binary, order, stride, flags)
+                ns, dtlb = run(binary, args.mode, args.requests)
+                print("tlb,%s,%d,%d,%s,%s,%s" % (name, order, stride, paging, ns,
+                                                 ",".join(dtlb.get(s, "") for s in SIDES)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Rebuild per-request timelines from a RING_TRACE dump (see src/trace.h).
+
+Reads the console output of the seL4 image or of tools/ring_host on stdin
+or from the files given, picks out the "trace_hz" and "trace" lines and
+follows every data slot from alloc to free on each channel. A slot's
+request id comes from its handler record, so the request and the response
+of one id can be joined into one timeline. A doorbell signal is charged to
+the entries of the commit that rang it, and a wakeup to the entries the
+receiver dequeued next that were signalled, or enqueued, before it.
+
+Prints a CSV row per request with the time of every stage relative to the
+request's enqueue, in ns when the counter frequency is known and in counter
+ticks otherwise, followed by percentiles of the time between stages.
+
+  tools/trace_timeline.py [--summary] [log ...]
+"""
+
+import argparse
+import fileinput
+import re
+
+ALLOC, ENQUEUE, SIGNAL, WAKE, DEQUEUE, HANDLER, FREE = range(1, 8)
+NO_SLOT = 0xffffffff
+DOORBELL = 0
+
+STAGES = ["alloc", "enqueue", "signal", "wake", "dequeue", "handler", "free"]
+EVENT_STAGE = {ALLOC: "alloc", ENQUEUE: "enqueue", DEQUEUE: "dequeue",
+               HANDLER: "handler", FREE: "free"}
+
+# gaps reported in the summary, as (from, to) pairs of "channel.stage"
+GAPS = [("req.enqueue", "req.dequeue"), ("req.dequeue", "req.handler"),
+        ("req.handler", "rsp.enqueue"), ("rsp.enqueue", "rsp.dequeue"),
+        ("rsp.dequeue", "rsp.handler"), ("req.enqueue", "rsp.handler"),
+        ("req.signal", "req.wake"), ("rsp.signal", "rsp.wake")]
+
+LINE = re.compile(r"trace (\w+) (\d+) (\d+) (\d+) (\d+)")
+HZ = re.compile(r"trace_hz (\d+)")
+
+
+def parse(lines):
+    hz = 0
+    ends = {}
+    for line in lines:
+        m = HZ.search(line)
+        if m:
+            hz = int(m.group(1))
+            continue
+        m = LINE.search(line)
+        if m:
+            end, time, event, slot, arg = m.groups()
+            ends.setdefault(end, []).append((int(time), int(event), int(slot), int(arg)))
+    return hz, ends
+
+
+def follow(sender, receiver):
+    """Return the slot lifecycles of one channel, each a dict of stage times."""
+    events = [(t, e, s, a, "send") for t, e, s, a in sender]
+    events += [(t, e, s, a, "recv") for t, e, s, a in receiver]
+    events.sort(key=lambda ev: (ev[0], ev[1]))
+
+    current = {}  # slot -> lifecycle in progress
+    done = []
+    commit = []   # lifecycles of the sender's last run of enqueues
+    woken = None  # time of the receiver's last wakeup, until it dequeues
+    dequeuing = False
+
+    for time, event, slot, arg, side in events:
+        if side == "send":
+            if event != ENQUEUE and event != SIGNAL:
+                commit = []
+        elif event != DEQUEUE and dequeuing:
+            woken = None
+            dequeuing = False
+
+        if event == SIGNAL:
+            if side == "send" and arg == DOORBELL:
+                for life in commit:
+                    life["signal"] = time
+                    # dequeued before its signal went out, by a receiver
+                    # woken for an earlier commit
+                    if life.get("wake", time) < time:
+                        del life["wake"]
+                commit = []
+            continue
+        if event == WAKE:
+            if side == "recv" and arg == DOORBELL:
+                woken = time
+            continue
+
+        life = current.get(slot)
+        if life is None or event == ALLOC:
+            if life is not None:
+                done.append(life)
+            life = current[slot] = {}
+        life[EVENT_STAGE[event]] = time
+        if event == ENQUEUE:
+            commit.append(life)
+        elif event == DEQUEUE:
+            dequeuing = True
+            # a wakeup only counts for entries enqueued before it, not
+            # for a later commit dequeued in the same run
+            if woken is not None and life.get("enqueue", woken) <= woken:
+                life["wake"] = woken
+        elif event == HANDLER:
+            life["id"] = arg
+        elif event == FREE:
+            done.append(life)
+            del current[slot]
+
+    done.extend(current.values())
+    return done
+
+
+def by_id(lives):
+    return {life["id"]: life for life in lives if "id" in life}
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--summary", action="store_true", help="print only the summary")
+    parser.add_argument("logs", nargs="*")
+    args = parser.parse_args()
+
+    hz, ends = parse(fileinput.input(args.logs))
+    req = by_id(follow(ends.get("req_send", []), ends.get("req_recv", [])))
+    rsp = by_id(follow(ends.get("rsp_send", []), ends.get("rsp_recv", [])))
+    unit = "ns" if hz else "ticks"
+
+    def scale(ticks):
+        return ticks * 1000000000 // hz if hz else ticks
+
+    timelines = []
+    for rid in sorted(set(req) & set(rsp)):
+        stages = {}
+        for chan, life in (("req", req[rid]), ("rsp", rsp[rid])):
+            for stage in STAGES:
+                if stage in life:
+                    stages[chan + "." + stage] = life[stage]
+        if "req.enqueue" in stages:
+            timelines.append((rid, stages))
+
+    if not args.summary:
+        columns = ["req." + s for s in STAGES] + ["rsp." + s for s in STAGES]
+        print("id," + ",".join(columns) + ",unit")
+        for rid, stages in timelines:
+            base = stages["req.enqueue"]
+            row = [str(scale(stages[c] - base)) if c in stages else "" for c in columns]
+            print("%d,%s,%s" % (rid, ",".join(row), unit))
+
+    print("requests %d, unit %s" % (len(timelines), unit))
+    for start, stop in GAPS:
+        gaps = [scale(s[stop] - s[start]) for _, s in timelines if start in s and stop in s]
+        if gaps:
+            print("%-12s -> %-12s count %7d p50 %9d p90 %9d p99 %9d max %9d" % (
+                start, stop, len(gaps), percentile(gaps, 0.5), percentile(gaps, 0.9),
+                percentile(gaps, 0.99), max(gaps)))
+
+
+if __name__ == "__main__":
+    main()